@@ -0,0 +1,157 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addrindex.h"
+
+#include "chainparams.h"
+#include "crypto/sha256.h"
+#include "main.h"
+#include "undo.h"
+#include "util.h"
+
+#include <map>
+
+CAddrIndex* paddrindex = NULL;
+
+/** Pending changes to the address index: the new state of each entry, or whether it is removed */
+typedef std::map<CAddrIndexKey, std::pair<bool, CAddrIndexEntry> > CAddrIndexChanges;
+
+static bool WriteChanges(CAddrIndexDB& db, const CAddrIndexChanges& changes)
+{
+    std::vector<std::pair<CAddrIndexKey, CAddrIndexEntry> > vWrite, vErase;
+    for (CAddrIndexChanges::const_iterator it = changes.begin(); it != changes.end(); it++) {
+        if (it->second.first)
+            vErase.push_back(std::make_pair(it->first, it->second.second));
+        else
+            vWrite.push_back(std::make_pair(it->first, it->second.second));
+    }
+    return db.WriteEntries(vWrite, vErase);
+}
+
+/** Look up an entry, among the pending changes first. Returns false if it doesn't exist. */
+static bool FindEntry(const CAddrIndexDB& db, const CAddrIndexChanges& changes, const CAddrIndexKey& key, CAddrIndexEntry& entry)
+{
+    CAddrIndexChanges::const_iterator it = changes.find(key);
+    if (it != changes.end()) {
+        entry = it->second.second;
+        return !it->second.first;
+    }
+    return db.ReadEntry(key, entry);
+}
+
+CAddrIndex::CAddrIndex(const CDBTuning& tuning, bool fMemory, bool fWipe) : db(tuning, fMemory, fWipe)
+{
+}
+
+uint256 CAddrIndex::GetScriptHash(const CScript& scriptPubKey)
+{
+    uint256 hash;
+    CSHA256().Write(begin_ptr(scriptPubKey), scriptPubKey.size()).Finalize(hash.begin());
+    return hash;
+}
+
+bool CAddrIndex::ReadBestBlock(CBlockLocator& locator) const
+{
+    return db.ReadBestBlock(locator);
+}
+
+bool CAddrIndex::WriteBestBlock(const CBlockLocator& locator)
+{
+    return db.WriteBestBlock(locator);
+}
+
+bool CAddrIndex::ReadUndo(const CBlockIndex* pindex, CBlockUndo& blockundo) const
+{
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        pos = pindex->GetUndoPos();
+    }
+    if (pos.IsNull())
+        return error("%s: no undo data available for %s", __func__, pindex->GetBlockHash().ToString());
+    return UndoReadFromDisk(blockundo, pos, pindex->pprev->GetBlockHash());
+}
+
+bool CAddrIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The genesis block has no undo data, and nothing to spend
+    CBlockUndo blockundo;
+    if (pindex->pprev && !ReadUndo(pindex, blockundo))
+        return false;
+    if (blockundo.vtxundo.size() + 1 != block.vtx.size() && pindex->pprev)
+        return error("%s: undo data doesn't match block %s", __func__, pindex->GetBlockHash().ToString());
+
+    CAddrIndexChanges changes;
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txid = tx.GetHash();
+        if (!tx.IsCoinBase()) {
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const CScript& scriptPubKey = txundo.vprevout[j].txout.scriptPubKey;
+                if (scriptPubKey.IsUnspendable())
+                    continue;
+                CAddrIndexKey key(GetScriptHash(scriptPubKey), tx.vin[j].prevout);
+                CAddrIndexEntry entry;
+                if (!FindEntry(db, changes, key, entry))
+                    return error("%s: %s spends %s, which is not in the index", __func__, txid.ToString(), tx.vin[j].prevout.ToString());
+                entry.spentBy = COutPoint(txid, j);
+                entry.nSpentHeight = pindex->nHeight;
+                changes[key] = std::make_pair(false, entry);
+            }
+        }
+        for (unsigned int j = 0; j < tx.vout.size(); j++) {
+            if (tx.vout[j].scriptPubKey.IsUnspendable())
+                continue;
+            CAddrIndexKey key(GetScriptHash(tx.vout[j].scriptPubKey), COutPoint(txid, j));
+            changes[key] = std::make_pair(false, CAddrIndexEntry(pindex->nHeight, tx.vout[j].nValue));
+        }
+    }
+    return WriteChanges(db, changes);
+}
+
+bool CAddrIndex::RewindBlock(const CBlockIndex* pindex)
+{
+    CBlock block;
+    CBlockUndo blockundo;
+    if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus()) || !ReadUndo(pindex, blockundo))
+        return false;
+    if (blockundo.vtxundo.size() + 1 != block.vtx.size())
+        return error("%s: undo data doesn't match block %s", __func__, pindex->GetBlockHash().ToString());
+
+    // In reverse order, so that outputs spent within the block end up removed.
+    CAddrIndexChanges changes;
+    for (unsigned int i = block.vtx.size(); i-- > 0; ) {
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txid = tx.GetHash();
+        for (unsigned int j = 0; j < tx.vout.size(); j++) {
+            if (tx.vout[j].scriptPubKey.IsUnspendable())
+                continue;
+            CAddrIndexKey key(GetScriptHash(tx.vout[j].scriptPubKey), COutPoint(txid, j));
+            changes[key] = std::make_pair(true, CAddrIndexEntry(pindex->nHeight, tx.vout[j].nValue));
+        }
+        if (!tx.IsCoinBase()) {
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const CScript& scriptPubKey = txundo.vprevout[j].txout.scriptPubKey;
+                if (scriptPubKey.IsUnspendable())
+                    continue;
+                CAddrIndexKey key(GetScriptHash(scriptPubKey), tx.vin[j].prevout);
+                CAddrIndexEntry entry;
+                if (!FindEntry(db, changes, key, entry))
+                    continue;
+                entry.spentBy.SetNull();
+                entry.nSpentHeight = 0;
+                changes[key] = std::make_pair(false, entry);
+            }
+        }
+    }
+    return WriteChanges(db, changes);
+}
+
+bool CAddrIndex::FindOutputs(const CScript& scriptPubKey, const CAddrIndexPos* pafter, size_t nMax,
+                             std::vector<std::pair<COutPoint, CAddrIndexEntry> >& vOutputs)
+{
+    return db.ReadOutputs(GetScriptHash(scriptPubKey), pafter, nMax, vOutputs);
+}
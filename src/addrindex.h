@@ -0,0 +1,64 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRINDEX_H
+#define BITCOIN_ADDRINDEX_H
+
+#include "chainindex.h"
+#include "txdb.h"
+
+#include <vector>
+
+class CBlockUndo;
+class CScript;
+
+/** Default for -addrindex */
+static const bool DEFAULT_ADDRINDEX = false;
+/** Maximum number of outputs returned by one address index query */
+static const unsigned int MAX_ADDRINDEX_QUERY = 1000;
+
+/**
+ * Address index (-addrindex): every output in the active chain, by the hash
+ * of its scriptPubKey, with the height it was created at and the input that
+ * spent it, if any. Kept in its own database (indexes/addrindex/).
+ *
+ * Spends are found through the block's undo data, which holds the
+ * scriptPubKeys of the outputs it spends; when a block is disconnected, its
+ * outputs are removed and the outputs it spent are marked unspent again.
+ * Unspendable outputs are not indexed.
+ */
+class CAddrIndex : public CChainIndex
+{
+private:
+    CAddrIndexDB db;
+
+    bool ReadUndo(const CBlockIndex* pindex, CBlockUndo& blockundo) const;
+
+protected:
+    const char* GetName() const { return "address index"; }
+    bool ReadBestBlock(CBlockLocator& locator) const;
+    bool WriteBestBlock(const CBlockLocator& locator);
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex);
+    bool RewindBlock(const CBlockIndex* pindex);
+
+public:
+    CAddrIndex(const CDBTuning& tuning, bool fMemory = false, bool fWipe = false);
+
+    /** Hash under which the outputs to a scriptPubKey are indexed (its SHA256) */
+    static uint256 GetScriptHash(const CScript& scriptPubKey);
+
+    /**
+     * Find up to nMax outputs to scriptPubKey, in the order they were
+     * created, starting after pafter (a position returned by an earlier
+     * call) if given.
+     */
+    bool FindOutputs(const CScript& scriptPubKey, const CAddrIndexPos* pafter, size_t nMax,
+                     std::vector<std::pair<COutPoint, CAddrIndexEntry> >& vOutputs);
+
+    const CAddrIndexDB& GetDB() const { return db; }
+};
+
+extern CAddrIndex* paddrindex;
+
+#endif // BITCOIN_ADDRINDEX_H
@@ -0,0 +1,69 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "arith_uint256.h"
+#include "chain.h"
+#include "hash.h"
+#include "main.h"
+
+#include <vector>
+
+static const int BENCH_CHAIN_LENGTH = 400000;
+
+static uint256 BenchBlockHash(uint32_t n)
+{
+    uint256 hash = ArithToUint256(arith_uint256(n));
+    return Hash(hash.begin(), hash.end());
+}
+
+// Lookups in a block index the size of the main chain's, half of them for
+// unknown hashes (as for an inv or getheaders locator from another branch).
+static void BlockMapFind(benchmark::State& state)
+{
+    BlockMap map;
+    std::vector<CBlockIndex> vIndex(BENCH_CHAIN_LENGTH);
+    for (int i = 0; i < BENCH_CHAIN_LENGTH; i++)
+        map.insert(std::make_pair(BenchBlockHash(i), &vIndex[i]));
+    // Enough different lookups that the table doesn't stay in cache
+    std::vector<uint256> vLookup;
+    for (int i = 0; i < 65536; i++)
+        vLookup.push_back(BenchBlockHash(i % 2 ? i * 6 : BENCH_CHAIN_LENGTH + i));
+
+    unsigned int n = 0, nFound = 0;
+    while (state.KeepRunning()) {
+        nFound += map.find(vLookup[n++ & 65535]) != map.end();
+    }
+    assert(nFound == n / 2);
+}
+
+// Finding the fork point of a short side branch near the tip.
+static void ChainFindFork(benchmark::State& state)
+{
+    std::vector<uint256> vHash(BENCH_CHAIN_LENGTH + 10);
+    std::vector<CBlockIndex> vIndex(BENCH_CHAIN_LENGTH + 10);
+    for (int i = 0; i < BENCH_CHAIN_LENGTH + 10; i++) {
+        vHash[i] = BenchBlockHash(i);
+        vIndex[i].phashBlock = &vHash[i];
+        if (i < BENCH_CHAIN_LENGTH) {
+            vIndex[i].nHeight = i;
+            vIndex[i].pprev = i ? &vIndex[i - 1] : NULL;
+        } else {
+            // Side branch off BENCH_CHAIN_LENGTH - 100
+            vIndex[i].nHeight = BENCH_CHAIN_LENGTH - 100 + (i - BENCH_CHAIN_LENGTH);
+            vIndex[i].pprev = i == BENCH_CHAIN_LENGTH ? &vIndex[BENCH_CHAIN_LENGTH - 101] : &vIndex[i - 1];
+        }
+        vIndex[i].BuildSkip();
+    }
+    CChain chain;
+    chain.SetTip(&vIndex[BENCH_CHAIN_LENGTH - 1]);
+
+    while (state.KeepRunning()) {
+        const CBlockIndex* pfork = chain.FindFork(&vIndex[BENCH_CHAIN_LENGTH + 9]);
+        assert(pfork == &vIndex[BENCH_CHAIN_LENGTH - 101]);
+    }
+}
+
+BENCHMARK(BlockMapFind);
+BENCHMARK(ChainFindFork);
@@ -0,0 +1,68 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "arith_uint256.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "version.h"
+
+/* Number of transactions in the block, about what fits in 1 MB */
+static const unsigned int BLOCK_TXS = 4000;
+
+/* Number of small messages, like inv, ping and headers traffic */
+static const unsigned int SMALL_MESSAGES = 1000;
+
+static CBlock MakeBlock()
+{
+    CBlock block;
+    for (unsigned int n = 0; n < BLOCK_TXS; n++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(ArithToUint256(arith_uint256(n + 1)), 0);
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 2) << std::vector<unsigned char>(33, 3);
+        tx.vout.resize(2);
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            tx.vout[i].nValue = 1000000;
+            tx.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+    return block;
+}
+
+// Serialize a block into a new stream and free it, as WriteBlockToDisk and
+// sending a block do
+template <typename Stream>
+static void StreamBlock(benchmark::State& state)
+{
+    const CBlock block = MakeBlock();
+    while (state.KeepRunning()) {
+        Stream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << block;
+    }
+}
+
+// Small messages, each in a stream of its own
+template <typename Stream>
+static void StreamSmallMessages(benchmark::State& state)
+{
+    const uint256 hash = ArithToUint256(arith_uint256(1));
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < SMALL_MESSAGES; i++) {
+            Stream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss << (uint32_t)i << hash;
+        }
+    }
+}
+
+static void DataStreamBlock(benchmark::State& state) { StreamBlock<CDataStream>(state); }
+static void PooledDataStreamBlock(benchmark::State& state) { StreamBlock<CPooledDataStream>(state); }
+static void DataStreamSmallMessages(benchmark::State& state) { StreamSmallMessages<CDataStream>(state); }
+static void PooledDataStreamSmallMessages(benchmark::State& state) { StreamSmallMessages<CPooledDataStream>(state); }
+
+BENCHMARK(DataStreamBlock);
+BENCHMARK(PooledDataStreamBlock);
+BENCHMARK(DataStreamSmallMessages);
+BENCHMARK(PooledDataStreamSmallMessages);
@@ -0,0 +1,125 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "arith_uint256.h"
+#include "main.h"
+#include "txmempool.h"
+
+#include <limits>
+
+static void AddTx(const CTransaction& tx, const CAmount& nFee, CTxMemPool& pool)
+{
+    pool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(MakeTransactionRef(tx), nFee, 0, 0.0, 1, pool.HasNoInputsOf(tx), 0, false, 1, LockPoints()));
+}
+
+static CMutableTransaction SpendTx(const uint256& hashPrev, unsigned int nPrevOuts, unsigned int nOutputs)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(nPrevOuts);
+    for (unsigned int i = 0; i < nPrevOuts; i++) {
+        tx.vin[i].prevout = COutPoint(hashPrev, i);
+        tx.vin[i].scriptSig = CScript() << OP_1;
+    }
+    tx.vout.resize(nOutputs);
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        tx.vout[i].scriptPubKey = CScript() << OP_1;
+        tx.vout[i].nValue = 1000;
+    }
+    return tx;
+}
+
+// Fill the pool with nChains chains of nDepth transactions each and return
+// the hash of the last transaction of every chain.
+static std::vector<uint256> MakeChains(CTxMemPool& pool, unsigned int nChains, unsigned int nDepth)
+{
+    std::vector<uint256> vTips;
+    for (unsigned int c = 0; c < nChains; c++) {
+        uint256 hashPrev = ArithToUint256(arith_uint256(c + 1));
+        for (unsigned int d = 0; d < nDepth; d++) {
+            CTransaction tx(SpendTx(hashPrev, 1, 1));
+            AddTx(tx, 1000, pool);
+            hashPrev = tx.GetHash();
+        }
+        vTips.push_back(hashPrev);
+    }
+    return vTips;
+}
+
+// Ancestor walk from the tip of a maximum-length (25 deep) chain, as done by
+// AcceptToMemoryPool for every transaction extending such a chain.
+static void MempoolAncestorsChain(benchmark::State& state)
+{
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    CTxMemPool pool(CFeeRate(0));
+    std::vector<uint256> vTips = MakeChains(pool, 100, DEFAULT_ANCESTOR_LIMIT);
+    std::string dummy;
+    unsigned int n = 0;
+    while (state.KeepRunning()) {
+        LOCK(pool.cs);
+        CTxMemPool::setEntries setAncestors;
+        CTxMemPool::txiter it = pool.mapTx.find(vTips[n++ % vTips.size()]);
+        pool.CalculateMemPoolAncestors(*it, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        assert(setAncestors.size() == DEFAULT_ANCESTOR_LIMIT - 1);
+    }
+}
+
+// Ancestor walk for a transaction spending the outputs of many unconfirmed
+// parents which share a common (chained) set of ancestors.
+static void MempoolAncestorsFanIn(benchmark::State& state)
+{
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    CTxMemPool pool(CFeeRate(0));
+    std::vector<uint256> vTips = MakeChains(pool, 1, 10);
+    CTransaction txFanOut(SpendTx(vTips[0], 1, 100));
+    AddTx(txFanOut, 1000, pool);
+    CMutableTransaction txFanIn;
+    for (unsigned int i = 0; i < 100; i++) {
+        CMutableTransaction mtx(SpendTx(txFanOut.GetHash(), 1, 1));
+        mtx.vin[0].prevout.n = i;
+        CTransaction tx(mtx);
+        AddTx(tx, 1000, pool);
+        txFanIn.vin.push_back(CTxIn(COutPoint(tx.GetHash(), 0)));
+    }
+    txFanIn.vout.resize(1, CTxOut(1000, CScript() << OP_1));
+    CTxMemPoolEntry entry(MakeTransactionRef(txFanIn), 1000, 0, 0.0, 1, false, 0, false, 1, LockPoints());
+    std::string dummy;
+    while (state.KeepRunning()) {
+        LOCK(pool.cs);
+        CTxMemPool::setEntries setAncestors;
+        pool.CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy);
+        assert(setAncestors.size() == 111);
+    }
+}
+
+// Descendant walk from a transaction with a wide fan-out of chained children.
+static void MempoolDescendantsFanOut(benchmark::State& state)
+{
+    CTxMemPool pool(CFeeRate(0));
+    std::vector<uint256> vTips = MakeChains(pool, 1, 1);
+    CTransaction txFanOut(SpendTx(vTips[0], 1, 100));
+    AddTx(txFanOut, 1000, pool);
+    for (unsigned int i = 0; i < 100; i++) {
+        CMutableTransaction mtx(SpendTx(txFanOut.GetHash(), 1, 1));
+        mtx.vin[0].prevout.n = i;
+        CTransaction tx(mtx);
+        AddTx(tx, 1000, pool);
+        uint256 hashPrev = tx.GetHash();
+        for (unsigned int d = 0; d < 5; d++) {
+            CTransaction txChild(SpendTx(hashPrev, 1, 1));
+            AddTx(txChild, 1000, pool);
+            hashPrev = txChild.GetHash();
+        }
+    }
+    while (state.KeepRunning()) {
+        LOCK(pool.cs);
+        CTxMemPool::setEntries setDescendants;
+        pool.CalculateDescendants(pool.mapTx.find(vTips[0]), setDescendants);
+        assert(setDescendants.size() == 602);
+    }
+}
+
+BENCHMARK(MempoolAncestorsChain);
+BENCHMARK(MempoolAncestorsFanIn);
+BENCHMARK(MempoolDescendantsFanOut);
@@ -0,0 +1,54 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "arith_uint256.h"
+#include "primitives/block.h"
+#include "serialize.h"
+#include "version.h"
+
+/* Number of transactions in the block, about what fits in 1 MB */
+static const unsigned int BLOCK_TXS = 4000;
+
+static CBlock MakeBlock()
+{
+    CBlock block;
+    block.vtx.reserve(BLOCK_TXS);
+    for (unsigned int n = 0; n < BLOCK_TXS; n++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(ArithToUint256(arith_uint256(n + 1)), 0);
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 2) << std::vector<unsigned char>(33, 3);
+        tx.vout.resize(2);
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            tx.vout[i].nValue = 1000000;
+            tx.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+    return block;
+}
+
+// The size of a block by running its serialization against a CSizeComputer
+static void SerializeSizeComputer(benchmark::State& state)
+{
+    const CBlock block = MakeBlock();
+    while (state.KeepRunning()) {
+        CSizeComputer s(SER_NETWORK, PROTOCOL_VERSION);
+        s << block;
+        assert(s.size() > BLOCK_TXS);
+    }
+}
+
+// The same from the cached transaction sizes
+static void SerializeSizeDirect(benchmark::State& state)
+{
+    const CBlock block = MakeBlock();
+    while (state.KeepRunning()) {
+        assert(::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION) > BLOCK_TXS);
+    }
+}
+
+BENCHMARK(SerializeSizeComputer);
+BENCHMARK(SerializeSizeDirect);
@@ -0,0 +1,57 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "arith_uint256.h"
+#include "primitives/transaction.h"
+#include "script/interpreter.h"
+#include "script/script.h"
+#include "uint256.h"
+
+/* Number of inputs of the transaction, like a large consolidation or batched payout */
+static const unsigned int LARGE_TX_INPUTS = 1000;
+
+static CTransaction MakeLargeTransaction(CScript& scriptCode)
+{
+    // Pay-to-pubkey-hash inputs with typical signature scripts
+    scriptCode = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+    CMutableTransaction tx;
+    tx.vin.resize(LARGE_TX_INPUTS);
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        tx.vin[i].prevout = COutPoint(ArithToUint256(arith_uint256(i + 1)), i % 4);
+        tx.vin[i].scriptSig = CScript() << std::vector<unsigned char>(72, 2) << std::vector<unsigned char>(33, 3);
+    }
+    tx.vout.resize(2);
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        tx.vout[i].nValue = 1000000;
+        tx.vout[i].scriptPubKey = scriptCode;
+    }
+    return tx;
+}
+
+// Signature hashes of all inputs of a large transaction, computed separately
+static void SignatureHashLarge(benchmark::State& state)
+{
+    CScript scriptCode;
+    const CTransaction tx = MakeLargeTransaction(scriptCode);
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < tx.vin.size(); i++)
+            SignatureHash(scriptCode, tx, i, SIGHASH_ALL);
+    }
+}
+
+// The same, sharing the precomputed data, as CheckInputs does
+static void SignatureHashLargePrecomputed(benchmark::State& state)
+{
+    CScript scriptCode;
+    const CTransaction tx = MakeLargeTransaction(scriptCode);
+    while (state.KeepRunning()) {
+        PrecomputedTransactionData txdata(tx);
+        for (unsigned int i = 0; i < tx.vin.size(); i++)
+            SignatureHash(scriptCode, tx, i, SIGHASH_ALL, &txdata);
+    }
+}
+
+BENCHMARK(SignatureHashLarge);
+BENCHMARK(SignatureHashLargePrecomputed);
@@ -0,0 +1,101 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "key.h"
+#include "policy/policy.h"
+#include "primitives/transaction.h"
+#include "pubkey.h"
+#include "script/interpreter.h"
+#include "script/script.h"
+
+#include <assert.h>
+
+/** Accepts every signature, like a signature cache hit, so only the script evaluation is measured. */
+class AlwaysValidSignatureChecker : public BaseSignatureChecker
+{
+public:
+    bool CheckSig(const CScriptStackValue& scriptSig, const CScriptStackValue& vchPubKey, const CScript& scriptCode) const
+    {
+        return true;
+    }
+};
+
+// A signed spend of a pay-to-pubkey-hash output
+static CMutableTransaction MakeP2PKHSpend(CScript& scriptPubKey)
+{
+    CKey key;
+    const std::vector<unsigned char> vchKey(32, 1);
+    key.Set(vchKey.begin(), vchKey.end(), true);
+    CPubKey pubkey = key.GetPubKey();
+    scriptPubKey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(pubkey.GetID()) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+    CMutableTransaction txCredit;
+    txCredit.vin.resize(1);
+    txCredit.vin[0].scriptSig = CScript() << OP_0 << OP_0;
+    txCredit.vout.resize(1);
+    txCredit.vout[0].scriptPubKey = scriptPubKey;
+    txCredit.vout[0].nValue = 1;
+
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(1);
+    txSpend.vin[0].prevout = COutPoint(txCredit.GetHash(), 0);
+    txSpend.vout.resize(1);
+    txSpend.vout[0].nValue = 1;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, txSpend, 0, SIGHASH_ALL);
+    bool fSigned = key.Sign(hash, vchSig);
+    assert(fSigned);
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    txSpend.vin[0].scriptSig = CScript() << vchSig << ToByteVector(pubkey);
+    return txSpend;
+}
+
+static void VerifyScriptP2PKH(benchmark::State& state)
+{
+    ECCVerifyHandle verifyHandle;
+    CScript scriptPubKey;
+    const CMutableTransaction txSpend = MakeP2PKHSpend(scriptPubKey);
+    while (state.KeepRunning()) {
+        ScriptError err;
+        bool fSuccess = VerifyScript(txSpend.vin[0].scriptSig, scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, MutableTransactionSignatureChecker(&txSpend, 0), &err);
+        assert(fSuccess && err == SCRIPT_ERR_OK);
+    }
+}
+
+// Script evaluation only, as for inputs whose signatures are cached
+static void VerifyScriptP2PKHCached(benchmark::State& state)
+{
+    CScript scriptPubKey;
+    const CMutableTransaction txSpend = MakeP2PKHSpend(scriptPubKey);
+    const AlwaysValidSignatureChecker checker;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; i++) {
+            ScriptError err;
+            bool fSuccess = VerifyScript(txSpend.vin[0].scriptSig, scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, checker, &err);
+            assert(fSuccess && err == SCRIPT_ERR_OK);
+        }
+    }
+}
+
+// The interpreter, which VerifyScript only runs for scripts it doesn't recognize
+static void EvalScriptP2PKHCached(benchmark::State& state)
+{
+    CScript scriptPubKey;
+    const CMutableTransaction txSpend = MakeP2PKHSpend(scriptPubKey);
+    const AlwaysValidSignatureChecker checker;
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000; i++) {
+            CScriptStack stack;
+            bool fSuccess = EvalScript(stack, txSpend.vin[0].scriptSig, STANDARD_SCRIPT_VERIFY_FLAGS, checker) &&
+                            EvalScript(stack, scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, checker);
+            assert(fSuccess && stack.size() == 1);
+        }
+    }
+}
+
+BENCHMARK(VerifyScriptP2PKH);
+BENCHMARK(VerifyScriptP2PKHCached);
+BENCHMARK(EvalScriptP2PKHCached);
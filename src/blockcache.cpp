@@ -0,0 +1,123 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+
+#include "core_memusage.h"
+#include "memusage.h"
+#include "streams.h"
+#include "version.h"
+
+CBlockCache::CBlockCache(size_t nMaxUsageIn) :
+    nMaxUsage(nMaxUsageIn), nUsage(0), nHits(0), nMisses(0)
+{
+}
+
+void CBlockCache::EvictUnchecked()
+{
+    while (nUsage > nMaxUsage && !listEntries.empty()) {
+        nUsage -= listEntries.back().nUsage;
+        mapEntries.erase(listEntries.back().hash);
+        listEntries.pop_back();
+    }
+}
+
+CBlockCache::entry* CBlockCache::FindUnchecked(const uint256& hash)
+{
+    std::map<uint256, entry_list::iterator>::iterator it = mapEntries.find(hash);
+    if (it == mapEntries.end()) {
+        nMisses++;
+        return NULL;
+    }
+    nHits++;
+    listEntries.splice(listEntries.begin(), listEntries, it->second);
+    return &*it->second;
+}
+
+void CBlockCache::SetMaxUsage(size_t nMaxUsageIn)
+{
+    LOCK(cs);
+    nMaxUsage = nMaxUsageIn;
+    EvictUnchecked();
+}
+
+void CBlockCache::Add(const CBlock& block)
+{
+    uint256 hash = block.GetHash();
+    LOCK(cs);
+    if (nMaxUsage == 0)
+        return;
+    std::map<uint256, entry_list::iterator>::iterator it = mapEntries.find(hash);
+    if (it != mapEntries.end()) {
+        listEntries.splice(listEntries.begin(), listEntries, it->second);
+        return;
+    }
+
+    listEntries.push_front(entry());
+    entry& e = listEntries.front();
+    e.hash = hash;
+    e.block = block;
+    CPooledDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+    e.vchBlock.assign(ss.begin(), ss.end());
+    // Account for the list node (2 pointers) and the map node (about 4 pointers) too.
+    e.nUsage = RecursiveDynamicUsage(e.block) + memusage::DynamicUsage(e.vchBlock) +
+               memusage::MallocUsage(sizeof(entry) + 2 * sizeof(void*)) +
+               memusage::MallocUsage(sizeof(uint256) + sizeof(entry_list::iterator) + 4 * sizeof(void*));
+    mapEntries.insert(std::make_pair(hash, listEntries.begin()));
+    nUsage += e.nUsage;
+    EvictUnchecked();
+}
+
+bool CBlockCache::Get(const uint256& hash, CBlock& block)
+{
+    LOCK(cs);
+    entry* e = FindUnchecked(hash);
+    if (!e)
+        return false;
+    block = e->block;
+    return true;
+}
+
+bool CBlockCache::GetRaw(const uint256& hash, std::vector<unsigned char>& vchBlock)
+{
+    LOCK(cs);
+    entry* e = FindUnchecked(hash);
+    if (!e)
+        return false;
+    vchBlock = e->vchBlock;
+    return true;
+}
+
+void CBlockCache::Clear()
+{
+    LOCK(cs);
+    listEntries.clear();
+    mapEntries.clear();
+    nUsage = 0;
+}
+
+unsigned long CBlockCache::size() const
+{
+    LOCK(cs);
+    return mapEntries.size();
+}
+
+size_t CBlockCache::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    return nUsage;
+}
+
+uint64_t CBlockCache::GetHits() const
+{
+    LOCK(cs);
+    return nHits;
+}
+
+uint64_t CBlockCache::GetMisses() const
+{
+    LOCK(cs);
+    return nMisses;
+}
@@ -0,0 +1,74 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKCACHE_H
+#define BITCOIN_BLOCKCACHE_H
+
+#include "primitives/block.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <list>
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+/** Default for -blockcache, the memory (in megabytes) used to cache recent blocks */
+static const unsigned int DEFAULT_BLOCK_CACHE_SIZE = 16;
+
+/**
+ * Memory-bounded cache of recently stored and connected blocks.
+ *
+ * Right after a new tip is connected the same block is read back by
+ * ProcessGetData for every peer that asks for it, by the ZMQ and RPC
+ * interfaces, and by DisconnectTip in case of a reorg. Each entry keeps both
+ * the deserialized block and its serialization, so neither form needs to
+ * touch the block files. Entries are evicted least recently used first.
+ *
+ * Blocks are keyed by hash and are never modified once written, so cached
+ * entries cannot go stale.
+ */
+class CBlockCache
+{
+private:
+    struct entry {
+        uint256 hash;
+        CBlock block;
+        std::vector<unsigned char> vchBlock;
+        size_t nUsage;
+    };
+
+    typedef std::list<entry> entry_list;
+
+    mutable CCriticalSection cs;
+    entry_list listEntries; //!< Most recently used first
+    std::map<uint256, entry_list::iterator> mapEntries;
+    size_t nMaxUsage;
+    size_t nUsage;
+    uint64_t nHits;
+    uint64_t nMisses;
+
+    void EvictUnchecked();
+    /** Look up a block and mark it as recently used. */
+    entry* FindUnchecked(const uint256& hash);
+
+public:
+    CBlockCache(size_t nMaxUsageIn = (size_t)DEFAULT_BLOCK_CACHE_SIZE * 1000000);
+
+    /** Change the memory limit, evicting entries if needed. 0 disables the cache. */
+    void SetMaxUsage(size_t nMaxUsageIn);
+
+    /** Add a block, or mark it as recently used if already cached. */
+    void Add(const CBlock& block);
+    bool Get(const uint256& hash, CBlock& block);
+    bool GetRaw(const uint256& hash, std::vector<unsigned char>& vchBlock);
+    void Clear();
+
+    unsigned long size() const;
+    size_t DynamicMemoryUsage() const;
+    uint64_t GetHits() const;
+    uint64_t GetMisses() const;
+};
+
+#endif // BITCOIN_BLOCKCACHE_H
@@ -0,0 +1,159 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilewriter.h"
+
+#include "main.h"
+#include "util.h"
+
+#include <boost/thread/thread.hpp>
+
+CBlockFileWriter::CBlockFileWriter() : nQueuedBytes(0), fRunning(false), fFailed(false)
+{
+}
+
+bool CBlockFileWriter::Process(const job& j)
+{
+    if (j.fCommit) {
+        CDiskBlockPos pos(j.pos.nFile, 0);
+        FILE *file = OpenBlockFile(pos);
+        if (file) {
+            if (j.fFinalize)
+                TruncateFile(file, j.nBlockSize);
+            FileCommit(file);
+            fclose(file);
+        }
+        file = OpenUndoFile(pos);
+        if (file) {
+            if (j.fFinalize)
+                TruncateFile(file, j.nUndoSize);
+            FileCommit(file);
+            fclose(file);
+        }
+        return true;
+    }
+
+    CDiskBlockPos posRecord(j.pos.nFile, j.pos.nPos - 8);
+    FILE *file = j.fUndo ? OpenUndoFile(posRecord) : OpenBlockFile(posRecord);
+    if (!file)
+        return error("%s: failed to open %s file for %s", __func__, j.fUndo ? "undo" : "block", j.pos.ToString());
+    bool fOk = fwrite(&j.vchData[0], 1, j.vchData.size(), file) == j.vchData.size();
+    if (fclose(file) != 0)
+        fOk = false;
+    if (!fOk)
+        return error("%s: failed to write %s data at %s", __func__, j.fUndo ? "undo" : "block", j.pos.ToString());
+    return true;
+}
+
+void CBlockFileWriter::Push(job& j, boost::unique_lock<boost::mutex>& lock)
+{
+    // Let a large record through an empty queue, so it can't wait forever.
+    while (fRunning && nQueuedBytes > 0 && nQueuedBytes + j.vchData.size() > MAX_BLOCKFILE_WRITE_QUEUE)
+        condDone.wait(lock);
+    if (!fRunning) {
+        if (!Process(j))
+            fFailed = true;
+        return;
+    }
+    nQueuedBytes += j.vchData.size();
+    queue.push_back(job());
+    job& q = queue.back();
+    q.fCommit = j.fCommit;
+    q.fUndo = j.fUndo;
+    q.pos = j.pos;
+    q.vchData.swap(j.vchData);
+    q.fFinalize = j.fFinalize;
+    q.nBlockSize = j.nBlockSize;
+    q.nUndoSize = j.nUndoSize;
+    condWork.notify_one();
+}
+
+void CBlockFileWriter::Write(const CDiskBlockPos& pos, bool fUndo, std::vector<unsigned char>& vchData)
+{
+    assert(pos.nPos >= 8 && vchData.size() >= 8);
+    job j;
+    j.fCommit = false;
+    j.fUndo = fUndo;
+    j.pos = pos;
+    j.vchData.swap(vchData);
+    j.fFinalize = false;
+    j.nBlockSize = 0;
+    j.nUndoSize = 0;
+
+    boost::this_thread::disable_interruption di;
+    boost::unique_lock<boost::mutex> lock(mutex);
+    Push(j, lock);
+}
+
+void CBlockFileWriter::Commit(int nFile, unsigned int nBlockSize, unsigned int nUndoSize, bool fFinalize)
+{
+    job j;
+    j.fCommit = true;
+    j.fUndo = false;
+    j.pos = CDiskBlockPos(nFile, 0);
+    j.fFinalize = fFinalize;
+    j.nBlockSize = nBlockSize;
+    j.nUndoSize = nUndoSize;
+
+    boost::this_thread::disable_interruption di;
+    boost::unique_lock<boost::mutex> lock(mutex);
+    Push(j, lock);
+}
+
+bool CBlockFileWriter::GetPending(const CDiskBlockPos& pos, bool fUndo, std::vector<unsigned char>& vchData)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    for (std::deque<job>::const_reverse_iterator it = queue.rbegin(); it != queue.rend(); ++it) {
+        if (!it->fCommit && it->fUndo == fUndo && it->pos == pos) {
+            vchData.assign(it->vchData.begin() + 8, it->vchData.end());
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CBlockFileWriter::Sync()
+{
+    boost::this_thread::disable_interruption di;
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (!queue.empty())
+        condDone.wait(lock);
+    bool fOk = !fFailed;
+    fFailed = false;
+    return fOk;
+}
+
+void CBlockFileWriter::Thread()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    fRunning = true;
+    try {
+        while (true) {
+            while (queue.empty())
+                condWork.wait(lock);
+            // The job stays queued while it is written, so that readers can
+            // still find it. Only this thread removes jobs.
+            const job& j = queue.front();
+            lock.unlock();
+            bool fOk = Process(j);
+            lock.lock();
+            if (!fOk)
+                fFailed = true;
+            nQueuedBytes -= j.vchData.size();
+            queue.pop_front();
+            condDone.notify_all();
+        }
+    } catch (const boost::thread_interrupted&) {
+        // Finish what was queued; from now on callers write directly.
+        fRunning = false;
+        while (!queue.empty()) {
+            if (!Process(queue.front()))
+                fFailed = true;
+            queue.pop_front();
+        }
+        nQueuedBytes = 0;
+        condDone.notify_all();
+        throw;
+    }
+}
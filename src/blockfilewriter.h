@@ -0,0 +1,80 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEWRITER_H
+#define BITCOIN_BLOCKFILEWRITER_H
+
+#include "chain.h"
+
+#include <deque>
+#include <stdint.h>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/** Maximum number of bytes of block and undo data waiting to be written */
+static const unsigned int MAX_BLOCKFILE_WRITE_QUEUE = 64 * 1000000;
+
+/**
+ * Writes block and undo records, and commits block files, on a dedicated
+ * thread.
+ *
+ * Positions are still assigned by FindBlockPos and FindUndoPos under
+ * cs_LastBlockFile, so the block index can refer to a record as soon as it is
+ * queued; only the file I/O and the fsync happen in the background. Records
+ * that are still queued are served from memory by the block and undo
+ * readers. Sync() is the durability barrier: once it returns true, everything
+ * queued before it is on disk.
+ *
+ * Jobs are processed in order. While no thread is running (before startup,
+ * after shutdown, and in tools and tests that don't start one) they are
+ * processed directly by the caller instead.
+ */
+class CBlockFileWriter
+{
+private:
+    struct job {
+        bool fCommit;
+        bool fUndo;
+        CDiskBlockPos pos;                  //!< Position of the record data, after the 8 byte header
+        std::vector<unsigned char> vchData; //!< Header and record data
+        // For commits of file pos.nFile:
+        bool fFinalize;
+        unsigned int nBlockSize;
+        unsigned int nUndoSize;
+    };
+
+    boost::mutex mutex;
+    boost::condition_variable condWork;
+    boost::condition_variable condDone;
+    std::deque<job> queue; //!< The front job is the one being processed
+    size_t nQueuedBytes;
+    bool fRunning;
+    bool fFailed;
+
+    bool Process(const job& j);
+    void Push(job& j, boost::unique_lock<boost::mutex>& lock);
+
+public:
+    CBlockFileWriter();
+
+    /**
+     * Queue a block (fUndo=false) or undo record. pos is the position of the
+     * record data, and vchData is the full record including its header;
+     * it is swapped out.
+     */
+    void Write(const CDiskBlockPos& pos, bool fUndo, std::vector<unsigned char>& vchData);
+    /** Queue a commit (and, if fFinalize, a truncation to the given sizes) of a block and undo file pair. */
+    void Commit(int nFile, unsigned int nBlockSize, unsigned int nUndoSize, bool fFinalize);
+    /** Get the data of a queued record at pos, without its header. */
+    bool GetPending(const CDiskBlockPos& pos, bool fUndo, std::vector<unsigned char>& vchData);
+    /** Wait until all queued jobs are done. Returns false if any job since the last Sync() failed. */
+    bool Sync();
+
+    /** Worker thread. Processes jobs until interrupted, then finishes the queue. */
+    void Thread();
+};
+
+#endif // BITCOIN_BLOCKFILEWRITER_H
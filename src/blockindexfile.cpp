@@ -0,0 +1,200 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockindexfile.h"
+
+#include "arith_uint256.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "crypto/common.h"
+#include "hash.h"
+#include "pow.h"
+#include "random.h"
+#include "util.h"
+
+#include <limits>
+
+#include <boost/filesystem.hpp>
+
+static const unsigned char BLOCK_INDEX_FILE_MAGIC[4] = {'b', 'i', 'd', 'x'};
+static const uint32_t BLOCK_INDEX_FILE_VERSION = 1;
+
+/** Record checksum, keyed by the file nonce so records of an older generation don't match */
+static uint64_t RecordChecksum(const unsigned char* pch, uint64_t nNonce)
+{
+    CSipHasher hasher(nNonce, 0);
+    for (unsigned int i = 0; i < BLOCK_INDEX_FILE_RECORD_SIZE - 8; i += 8)
+        hasher.Write(ReadLE64(pch + i));
+    return hasher.Finalize();
+}
+
+CBlockIndexFile::CBlockIndexFile(const boost::filesystem::path& pathIn) :
+    path(pathIn), file(NULL), nNonce(0), nSize(0), nRecords(0)
+{
+}
+
+CBlockIndexFile::~CBlockIndexFile()
+{
+    Close();
+}
+
+void CBlockIndexFile::Serialize(unsigned char* pch, const CBlockIndex* pindex) const
+{
+    uint256 hashPrev = pindex->pprev ? pindex->pprev->GetBlockHash() : uint256();
+    uint256 nChainWork = ArithToUint256(pindex->nChainWork);
+    memcpy(pch, pindex->GetBlockHash().begin(), 32);
+    memcpy(pch + 32, hashPrev.begin(), 32);
+    memcpy(pch + 64, pindex->hashMerkleRoot.begin(), 32);
+    memcpy(pch + 96, nChainWork.begin(), 32);
+    WriteLE32(pch + 128, pindex->nVersion);
+    WriteLE32(pch + 132, pindex->nTime);
+    WriteLE32(pch + 136, pindex->nBits);
+    WriteLE32(pch + 140, pindex->nNonce);
+    WriteLE32(pch + 144, pindex->nHeight);
+    WriteLE32(pch + 148, pindex->nStatus);
+    WriteLE32(pch + 152, pindex->nTx);
+    WriteLE32(pch + 156, pindex->nFile);
+    WriteLE32(pch + 160, pindex->nDataPos);
+    WriteLE32(pch + 164, pindex->nUndoPos);
+    WriteLE64(pch + 168, RecordChecksum(pch, nNonce));
+}
+
+bool CBlockIndexFile::Load(uint64_t nNonceIn, uint64_t nSizeIn, boost::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+{
+    Close();
+    if (nSizeIn < BLOCK_INDEX_FILE_HEADER_SIZE || (nSizeIn - BLOCK_INDEX_FILE_HEADER_SIZE) % BLOCK_INDEX_FILE_RECORD_SIZE != 0)
+        return false;
+    FILE* filein = fopen(path.string().c_str(), "rb+");
+    if (!filein)
+        return false;
+
+    // Read the whole file and check it before touching the block index, so
+    // that a bad file leaves nothing behind.
+    std::vector<unsigned char> vch(nSizeIn);
+    if (fread(&vch[0], 1, nSizeIn, filein) != nSizeIn ||
+        memcmp(&vch[0], BLOCK_INDEX_FILE_MAGIC, 4) ||
+        ReadLE32(&vch[4]) != BLOCK_INDEX_FILE_VERSION ||
+        ReadLE64(&vch[8]) != nNonceIn) {
+        LogPrintf("%s: %s doesn't match the block index database, ignoring it\n", __func__, path.string());
+        fclose(filein);
+        return false;
+    }
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    for (uint64_t nPos = BLOCK_INDEX_FILE_HEADER_SIZE; nPos < nSizeIn; nPos += BLOCK_INDEX_FILE_RECORD_SIZE) {
+        const unsigned char* pch = &vch[nPos];
+        uint256 hash;
+        memcpy(hash.begin(), pch, 32);
+        if (RecordChecksum(pch, nNonceIn) != ReadLE64(pch + 168) ||
+            !CheckProofOfWork(hash, ReadLE32(pch + 136), consensusParams)) {
+            LogPrintf("%s: corrupt record at position %u of %s, ignoring the file\n", __func__, nPos, path.string());
+            fclose(filein);
+            return false;
+        }
+    }
+
+    for (uint64_t nPos = BLOCK_INDEX_FILE_HEADER_SIZE; nPos < nSizeIn; nPos += BLOCK_INDEX_FILE_RECORD_SIZE) {
+        const unsigned char* pch = &vch[nPos];
+        uint256 hash, hashPrev, nChainWork;
+        memcpy(hash.begin(), pch, 32);
+        memcpy(hashPrev.begin(), pch + 32, 32);
+        memcpy(nChainWork.begin(), pch + 96, 32);
+
+        // Construct block index object
+        CBlockIndex* pindexNew = insertBlockIndex(hash);
+        pindexNew->pprev          = insertBlockIndex(hashPrev);
+        memcpy(pindexNew->hashMerkleRoot.begin(), pch + 64, 32);
+        pindexNew->nChainWork     = UintToArith256(nChainWork);
+        pindexNew->nVersion       = ReadLE32(pch + 128);
+        pindexNew->nTime          = ReadLE32(pch + 132);
+        pindexNew->nBits          = ReadLE32(pch + 136);
+        pindexNew->nNonce         = ReadLE32(pch + 140);
+        pindexNew->nHeight        = ReadLE32(pch + 144);
+        pindexNew->nStatus        = ReadLE32(pch + 148);
+        pindexNew->nTx            = ReadLE32(pch + 152);
+        pindexNew->nFile          = ReadLE32(pch + 156);
+        pindexNew->nDataPos       = ReadLE32(pch + 160);
+        pindexNew->nUndoPos       = ReadLE32(pch + 164);
+    }
+
+    // Drop anything appended after the database was last written.
+    TruncateFile(filein, nSizeIn);
+    file = filein;
+    nNonce = nNonceIn;
+    nSize = nSizeIn;
+    nRecords = (nSizeIn - BLOCK_INDEX_FILE_HEADER_SIZE) / BLOCK_INDEX_FILE_RECORD_SIZE;
+    return true;
+}
+
+bool CBlockIndexFile::Append(const std::vector<const CBlockIndex*>& vIndex)
+{
+    if (!file)
+        return false;
+    if (vIndex.empty())
+        return true;
+
+    std::vector<unsigned char> vch(vIndex.size() * BLOCK_INDEX_FILE_RECORD_SIZE);
+    for (size_t i = 0; i < vIndex.size(); i++)
+        Serialize(&vch[i * BLOCK_INDEX_FILE_RECORD_SIZE], vIndex[i]);
+    if (fseek(file, nSize, SEEK_SET) || fwrite(&vch[0], 1, vch.size(), file) != vch.size() || fflush(file)) {
+        LogPrintf("%s: unable to write to %s\n", __func__, path.string());
+        Close();
+        return false;
+    }
+    FileCommit(file);
+    nSize += vch.size();
+    nRecords += vIndex.size();
+    return true;
+}
+
+bool CBlockIndexFile::Rewrite(const std::vector<const CBlockIndex*>& vIndex)
+{
+    Close();
+    boost::filesystem::path pathTmp = path.string() + ".new";
+    FILE* fileout = fopen(pathTmp.string().c_str(), "wb");
+    if (!fileout)
+        return error("%s: unable to create %s", __func__, pathTmp.string());
+
+    nNonce = GetRand(std::numeric_limits<uint64_t>::max());
+    std::vector<unsigned char> vch(BLOCK_INDEX_FILE_HEADER_SIZE + vIndex.size() * BLOCK_INDEX_FILE_RECORD_SIZE);
+    memcpy(&vch[0], BLOCK_INDEX_FILE_MAGIC, 4);
+    WriteLE32(&vch[4], BLOCK_INDEX_FILE_VERSION);
+    WriteLE64(&vch[8], nNonce);
+    for (size_t i = 0; i < vIndex.size(); i++)
+        Serialize(&vch[BLOCK_INDEX_FILE_HEADER_SIZE + i * BLOCK_INDEX_FILE_RECORD_SIZE], vIndex[i]);
+    if (fwrite(&vch[0], 1, vch.size(), fileout) != vch.size() || fflush(fileout)) {
+        fclose(fileout);
+        return error("%s: unable to write %s", __func__, pathTmp.string());
+    }
+    FileCommit(fileout);
+    fclose(fileout);
+    if (!RenameOver(pathTmp, path))
+        return error("%s: unable to rename %s", __func__, pathTmp.string());
+
+    file = fopen(path.string().c_str(), "rb+");
+    if (!file)
+        return error("%s: unable to open %s", __func__, path.string());
+    nSize = vch.size();
+    nRecords = vIndex.size();
+    return true;
+}
+
+void CBlockIndexFile::Close()
+{
+    if (file) {
+        fclose(file);
+        file = NULL;
+    }
+    nSize = 0;
+    nRecords = 0;
+}
+
+void CBlockIndexFile::Remove()
+{
+    Close();
+    try {
+        boost::filesystem::remove(path);
+    } catch (const boost::filesystem::filesystem_error& e) {
+        LogPrintf("%s: unable to remove %s: %s\n", __func__, path.string(), e.what());
+    }
+}
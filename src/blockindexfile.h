@@ -0,0 +1,71 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKINDEXFILE_H
+#define BITCOIN_BLOCKINDEXFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/function.hpp>
+
+class CBlockIndex;
+class uint256;
+
+/** Size of the header of the flat block index file */
+static const unsigned int BLOCK_INDEX_FILE_HEADER_SIZE = 16;
+/** Size of one record in the flat block index file */
+static const unsigned int BLOCK_INDEX_FILE_RECORD_SIZE = 176;
+
+/**
+ * Flat-file copy of the block index, loaded at startup instead of iterating
+ * over every entry in the block tree database.
+ *
+ * The file is a 16 byte header (magic, version and a random nonce) followed
+ * by fixed-size records, one per written CBlockIndex, including its
+ * precomputed chain work. Updated entries are appended, so the last record
+ * for a block wins, and the file is rewritten from scratch once it holds
+ * mostly stale records.
+ *
+ * The database stays authoritative: every write also goes to it, and it
+ * stores the nonce and length of the file as of its last write. A file that
+ * doesn't match (missing, from another generation, truncated, or with a bad
+ * record checksum) is ignored, and the index is loaded from the database.
+ */
+class CBlockIndexFile
+{
+private:
+    boost::filesystem::path path;
+    FILE* file;
+    uint64_t nNonce;
+    uint64_t nSize;    //!< Bytes of the file covered by the database marker
+    uint64_t nRecords;
+
+    void Serialize(unsigned char* pch, const CBlockIndex* pindex) const;
+
+public:
+    CBlockIndexFile(const boost::filesystem::path& pathIn);
+    ~CBlockIndexFile();
+
+    /**
+     * Load all entries, if the file matches nNonceIn and nSizeIn. Keeps the
+     * file open for appending on success.
+     */
+    bool Load(uint64_t nNonceIn, uint64_t nSizeIn, boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    /** Append and sync records for the given entries. */
+    bool Append(const std::vector<const CBlockIndex*>& vIndex);
+    /** Replace the file with one holding exactly the given entries, under a new nonce. */
+    bool Rewrite(const std::vector<const CBlockIndex*>& vIndex);
+    void Close();
+    void Remove();
+
+    bool IsOpen() const { return file != NULL; }
+    uint64_t GetNonce() const { return nNonce; }
+    uint64_t GetSize() const { return nSize; }
+    uint64_t GetRecordCount() const { return nRecords; }
+};
+
+#endif // BITCOIN_BLOCKINDEXFILE_H
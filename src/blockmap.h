@@ -0,0 +1,177 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKMAP_H
+#define BITCOIN_BLOCKMAP_H
+
+#include "uint256.h"
+
+#include <iterator>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+class CBlockIndex;
+
+/**
+ * Hash table from block hash to CBlockIndex*, as used for mapBlockIndex.
+ *
+ * Open addressing with linear probing: the hashes and pointers are stored
+ * inline in one flat array, so there is no per-entry allocation and no
+ * bucket pointer to follow. Next to it is a dense array of 8 byte tags (the
+ * first 8 bytes of the hash, with the low bit set; 0 marks an empty slot),
+ * so probing for a block we don't know about never touches the entries, and
+ * a hit usually compares one full hash.
+ *
+ * Entries are never removed individually (the block index only grows), so
+ * there is no erase(). Unlike boost::unordered_map, inserting moves
+ * existing entries when the table grows: iterators and references to
+ * elements are invalidated by insert() and operator[], and the keys must not
+ * be used as stable storage (CBlockIndexArena keeps CBlockIndex::phashBlock).
+ */
+class BlockMap
+{
+public:
+    typedef uint256 key_type;
+    typedef CBlockIndex* mapped_type;
+    typedef std::pair<uint256, CBlockIndex*> value_type;
+    typedef size_t size_type;
+
+private:
+    std::vector<uint64_t> vTags;    //!< Size is zero or a power of two
+    std::vector<value_type> vSlots; //!< Same size as vTags
+    size_t nSize;
+
+    static uint64_t Tag(const uint256& hash) { return hash.GetCheapHash() | 1; }
+
+    size_t Mask() const { return vTags.size() - 1; }
+
+    /** Slot holding hash, or the empty slot where it would go. Requires a non-empty table. */
+    size_t Probe(const uint256& hash, uint64_t nTag) const
+    {
+        for (size_t i = nTag & Mask(); ; i = (i + 1) & Mask()) {
+            if (vTags[i] == 0 || (vTags[i] == nTag && vSlots[i].first == hash))
+                return i;
+        }
+    }
+
+    void Rehash(size_t nSlots)
+    {
+        std::vector<uint64_t> vOldTags(nSlots);
+        std::vector<value_type> vOldSlots(nSlots);
+        vOldTags.swap(vTags);
+        vOldSlots.swap(vSlots);
+        for (size_t i = 0; i < vOldTags.size(); i++) {
+            if (vOldTags[i]) {
+                size_t j = Probe(vOldSlots[i].first, vOldTags[i]);
+                vTags[j] = vOldTags[i];
+                vSlots[j] = vOldSlots[i];
+            }
+        }
+    }
+
+    template <typename Value>
+    class iterator_base : public std::iterator<std::forward_iterator_tag, Value>
+    {
+    private:
+        const uint64_t* pTag;
+        const uint64_t* pTagEnd;
+        Value* p;
+
+        void Skip() { while (pTag != pTagEnd && *pTag == 0) { ++pTag; ++p; } }
+
+    public:
+        iterator_base() : pTag(NULL), pTagEnd(NULL), p(NULL) {}
+        iterator_base(const uint64_t* pTagIn, const uint64_t* pTagEndIn, Value* pIn) : pTag(pTagIn), pTagEnd(pTagEndIn), p(pIn) { Skip(); }
+        template <typename V>
+        iterator_base(const iterator_base<V>& other) : pTag(other.pTag), pTagEnd(other.pTagEnd), p(other.p) {}
+
+        Value& operator*() const { return *p; }
+        Value* operator->() const { return p; }
+        iterator_base& operator++() { ++pTag; ++p; Skip(); return *this; }
+        iterator_base operator++(int) { iterator_base ret = *this; ++*this; return ret; }
+        bool operator==(const iterator_base& other) const { return pTag == other.pTag; }
+        bool operator!=(const iterator_base& other) const { return pTag != other.pTag; }
+
+        template <typename V> friend class iterator_base;
+    };
+
+public:
+    typedef iterator_base<value_type> iterator;
+    typedef iterator_base<const value_type> const_iterator;
+
+private:
+    iterator MakeIterator(size_t i)
+    {
+        if (vTags.empty())
+            return iterator();
+        return iterator(&vTags[0] + i, &vTags[0] + vTags.size(), &vSlots[0] + i);
+    }
+
+public:
+    BlockMap() : nSize(0) {}
+
+    iterator begin() { return MakeIterator(0); }
+    iterator end() { return MakeIterator(vTags.size()); }
+    const_iterator begin() const { return const_cast<BlockMap*>(this)->begin(); }
+    const_iterator end() const { return const_cast<BlockMap*>(this)->end(); }
+
+    iterator find(const uint256& hash)
+    {
+        if (vTags.empty())
+            return end();
+        size_t i = Probe(hash, Tag(hash));
+        if (vTags[i] == 0)
+            return end();
+        return MakeIterator(i);
+    }
+
+    const_iterator find(const uint256& hash) const
+    {
+        return const_cast<BlockMap*>(this)->find(hash);
+    }
+
+    size_t count(const uint256& hash) const { return find(hash) != end(); }
+
+    /** Make room for at least n entries without growing. */
+    void reserve(size_t n)
+    {
+        size_t nSlots = vTags.empty() ? 16 : vTags.size();
+        while (n > nSlots / 4 * 3)
+            nSlots *= 2;
+        if (nSlots != vTags.size())
+            Rehash(nSlots);
+    }
+
+    std::pair<iterator, bool> insert(const value_type& value)
+    {
+        reserve(nSize + 1);
+        uint64_t nTag = Tag(value.first);
+        size_t i = Probe(value.first, nTag);
+        bool fInserted = vTags[i] == 0;
+        if (fInserted) {
+            vTags[i] = nTag;
+            vSlots[i] = value;
+            nSize++;
+        }
+        return std::make_pair(MakeIterator(i), fInserted);
+    }
+
+    CBlockIndex*& operator[](const uint256& hash)
+    {
+        return insert(value_type(hash, NULL)).first->second;
+    }
+
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+
+    void clear()
+    {
+        std::vector<uint64_t>().swap(vTags);
+        std::vector<value_type>().swap(vSlots);
+        nSize = 0;
+    }
+};
+
+#endif // BITCOIN_BLOCKMAP_H
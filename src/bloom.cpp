@@ -6,6 +6,7 @@
 
 #include "primitives/transaction.h"
 #include "hash.h"
+#include "memusage.h"
 #include "script/script.h"
 #include "script/standard.h"
 #include "random.h"
@@ -313,3 +314,41 @@ void CRollingBloomFilter::reset()
         *it = 0;
     }
 }
+
+static const int TXID_FILTER_HASH_FUNCS = 7;
+
+CTxidFilter::CTxidFilter(size_t nBytes) : data(std::max<size_t>(nBytes / 8, 1)), nInserted(0)
+{
+    nTweak0 = GetRand(std::numeric_limits<uint64_t>::max());
+    nTweak1 = GetRand(std::numeric_limits<uint64_t>::max());
+}
+
+void CTxidFilter::insert(const uint256& txid)
+{
+    uint64_t nBits = data.size() * 64;
+    uint64_t h1 = txid.GetUint64(0) ^ nTweak0;
+    uint64_t h2 = (txid.GetUint64(1) ^ nTweak1) | 1;
+    for (int i = 0; i < TXID_FILTER_HASH_FUNCS; i++) {
+        uint64_t nBit = (h1 + i * h2) % nBits;
+        data[nBit >> 6] |= (uint64_t)1 << (nBit & 63);
+    }
+    nInserted++;
+}
+
+bool CTxidFilter::contains(const uint256& txid) const
+{
+    uint64_t nBits = data.size() * 64;
+    uint64_t h1 = txid.GetUint64(0) ^ nTweak0;
+    uint64_t h2 = (txid.GetUint64(1) ^ nTweak1) | 1;
+    for (int i = 0; i < TXID_FILTER_HASH_FUNCS; i++) {
+        uint64_t nBit = (h1 + i * h2) % nBits;
+        if (!(data[nBit >> 6] & ((uint64_t)1 << (nBit & 63))))
+            return false;
+    }
+    return true;
+}
+
+size_t CTxidFilter::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(data);
+}
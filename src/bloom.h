@@ -140,4 +140,38 @@ private:
     int nHashFuncs;
 };
 
+/**
+ * Bloom filter over a large set of txids, such as all transactions with
+ * unspent outputs, to rule out lookups of ones that aren't in it.
+ *
+ * Unlike CBloomFilter it is not bounded by the BIP37 limits. Items can't be
+ * removed, so removed ones keep matching until the filter is replaced by a
+ * newly built one. The txids are hashes already, so their bits are used
+ * directly (mixed with a random tweak) rather than hashed again.
+ *
+ * It uses 7 hash functions, which gives a 1% false positive rate at 10 bits
+ * per element.
+ */
+class CTxidFilter
+{
+public:
+    // A random filter calls GetRand() at creation time.
+    CTxidFilter(size_t nBytes);
+
+    void insert(const uint256& txid);
+    bool contains(const uint256& txid) const;
+
+    //! Number of insert() calls, including repeated txids
+    size_t GetInserted() const { return nInserted; }
+    //! Number of elements the filter is sized for
+    size_t GetCapacity() const { return data.size() * 64 / 10; }
+    size_t DynamicMemoryUsage() const;
+
+private:
+    std::vector<uint64_t> data;
+    uint64_t nTweak0;
+    uint64_t nTweak1;
+    size_t nInserted;
+};
+
 #endif // BITCOIN_BLOOM_H
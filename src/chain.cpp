@@ -111,6 +111,27 @@ void CBlockIndex::BuildSkip()
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
 
+CBlockIndex* CBlockIndexArena::Allocate(const uint256& hash, const CBlockIndex& index)
+{
+    if (nUsed == CHUNK_SIZE) {
+        vChunks.push_back(new entry[CHUNK_SIZE]);
+        nUsed = 0;
+    }
+    entry& e = vChunks.back()[nUsed++];
+    e.hash = hash;
+    e.index = index;
+    e.index.phashBlock = &e.hash;
+    return &e.index;
+}
+
+void CBlockIndexArena::Clear()
+{
+    for (size_t i = 0; i < vChunks.size(); i++)
+        delete[] vChunks[i];
+    vChunks.clear();
+    nUsed = CHUNK_SIZE;
+}
+
 arith_uint256 GetBlockProof(const CBlockIndex& block)
 {
     arith_uint256 bnTarget;
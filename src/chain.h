@@ -338,6 +338,41 @@ arith_uint256 GetBlockProof(const CBlockIndex& block);
 /** Return the time it would take to redo the work difference between from and to, assuming the current hashrate corresponds to the difficulty at tip, in seconds. */
 int64_t GetBlockProofEquivalentTime(const CBlockIndex& to, const CBlockIndex& from, const CBlockIndex& tip, const Consensus::Params&);
 
+/**
+ * Allocator for the CBlockIndex objects in mapBlockIndex. Objects are
+ * allocated in large chunks rather than with one heap allocation each, and
+ * are only freed all at once. Each object's block hash lives in the arena
+ * too, since BlockMap moves its keys around.
+ */
+class CBlockIndexArena
+{
+private:
+    static const size_t CHUNK_SIZE = 4096;
+
+    struct entry {
+        uint256 hash;
+        CBlockIndex index;
+    };
+
+    std::vector<entry*> vChunks;
+    size_t nUsed; //!< Objects handed out from the last chunk
+
+    CBlockIndexArena(const CBlockIndexArena&);
+    void operator=(const CBlockIndexArena&);
+
+public:
+    CBlockIndexArena() : nUsed(CHUNK_SIZE) {}
+    ~CBlockIndexArena() { Clear(); }
+
+    /**
+     * Return a new copy of index, with phashBlock pointing at a copy of hash
+     * that is stored next to it.
+     */
+    CBlockIndex* Allocate(const uint256& hash, const CBlockIndex& index = CBlockIndex());
+    /** Free all objects returned by Allocate(). */
+    void Clear();
+};
+
 /** Used to marshal pointers into hashes for db storage. */
 class CDiskBlockIndex : public CBlockIndex
 {
@@ -0,0 +1,185 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainindex.h"
+
+#include "chainparams.h"
+#include "main.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/thread/thread.hpp>
+
+/** Seconds between progress messages and saves of the best block while catching up */
+static const int64_t CHAIN_INDEX_PROGRESS_INTERVAL = 30;
+
+CChainIndex::CChainIndex() : pindexBest(NULL), fSynced(false), pindexSaved(NULL), fNewBlock(false)
+{
+}
+
+bool CChainIndex::Init()
+{
+    CBlockLocator locator;
+    if (!ReadBestBlock(locator))
+        locator.SetNull();
+
+    LOCK(cs_main);
+    pindexBest = NULL;
+    if (!locator.IsNull()) {
+        // Start from the exact block, so that a block which was disconnected
+        // while the node was down gets rewound.
+        BlockMap::iterator it = mapBlockIndex.find(locator.vHave[0]);
+        pindexBest = it != mapBlockIndex.end() ? it->second : FindForkInGlobalIndex(chainActive, locator);
+    }
+    pindexSaved = pindexBest;
+    if (pindexBest)
+        LogPrintf("Resuming the %s at height %d\n", GetName(), pindexBest->nHeight);
+    return true;
+}
+
+bool CChainIndex::IsSynced() const
+{
+    AssertLockHeld(cs_main);
+    return pindexBest == chainActive.Tip();
+}
+
+void CChainIndex::BlockUntilSyncedToCurrentChain()
+{
+    const CBlockIndex* pindexTip;
+    {
+        LOCK(cs_main);
+        if (!fSynced || pindexBest == chainActive.Tip())
+            return;
+        pindexTip = chainActive.Tip();
+    }
+
+    boost::system_time deadline = boost::get_system_time() + boost::posix_time::seconds(10);
+    boost::unique_lock<boost::mutex> lock(mutexBest);
+    while (true) {
+        {
+            LOCK(cs_main);
+            // Blocks that were disconnected meanwhile must be rewound too
+            if (pindexBest && pindexBest->nHeight >= pindexTip->nHeight && chainActive.Contains(pindexBest))
+                return;
+        }
+        if (!condBest.timed_wait(lock, deadline))
+            return;
+    }
+}
+
+void CChainIndex::SyncTransaction(const CTransaction& tx, const CBlockIndex* pindex, const CBlock* pblock)
+{
+    // Called for every transaction of a connected block, also during the
+    // initial block download, which UpdatedBlockTip isn't.
+    if (!pindex)
+        return;
+    boost::unique_lock<boost::mutex> lock(mutex);
+    fNewBlock = true;
+    cond.notify_one();
+}
+
+void CChainIndex::SetBest(const CBlockIndex* pindex)
+{
+    {
+        LOCK(cs_main);
+        pindexBest = pindex;
+    }
+    boost::unique_lock<boost::mutex> lock(mutexBest);
+    condBest.notify_all();
+}
+
+void CChainIndex::SaveBest()
+{
+    CBlockLocator locator;
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = pindexBest;
+        if (pindex == pindexSaved)
+            return;
+        if (pindex)
+            locator = chainActive.GetLocator(pindex);
+    }
+    if (WriteBestBlock(locator))
+        pindexSaved = pindex;
+}
+
+void CChainIndex::WaitForBlock()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (!fNewBlock)
+        cond.wait(lock);
+    fNewBlock = false;
+}
+
+void CChainIndex::Thread()
+{
+    int64_t nLastProgress = GetTime();
+    try {
+        while (true) {
+            boost::this_thread::interruption_point();
+
+            const CBlockIndex* pindexRewind = NULL;
+            const CBlockIndex* pindexNext = NULL;
+            CDiskBlockPos posNext;
+            int nTipHeight;
+            bool fLogSynced = false;
+            {
+                LOCK(cs_main);
+                if (pindexBest && !chainActive.Contains(pindexBest)) {
+                    pindexRewind = pindexBest;
+                } else {
+                    pindexNext = pindexBest ? chainActive.Next(pindexBest) : chainActive.Genesis();
+                    if (pindexNext)
+                        posNext = pindexNext->GetBlockPos();
+                }
+                nTipHeight = chainActive.Height();
+                if (!pindexRewind && !pindexNext && !fSynced && pindexBest) {
+                    fSynced = true;
+                    fLogSynced = true;
+                }
+            }
+
+            if (pindexRewind) {
+                if (!RewindBlock(pindexRewind)) {
+                    LogPrintf("%s: unable to remove block %s from the %s\n", __func__, pindexRewind->GetBlockHash().ToString(), GetName());
+                    WaitForBlock();
+                    continue;
+                }
+                SetBest(pindexRewind->pprev);
+                SaveBest();
+                continue;
+            }
+
+            if (!pindexNext) {
+                if (fLogSynced)
+                    LogPrintf("Synced the %s at height %d\n", GetName(), nTipHeight);
+                SaveBest();
+                WaitForBlock();
+                continue;
+            }
+
+            // The block may have been disconnected meanwhile; in that case,
+            // or if it can't be read, wait for the next block before trying
+            // again.
+            CBlock block;
+            if (!ReadBlockFromDisk(block, posNext, Params().GetConsensus()) || block.GetHash() != pindexNext->GetBlockHash() ||
+                !WriteBlock(block, pindexNext)) {
+                LogPrintf("%s: unable to add block %s to the %s\n", __func__, pindexNext->GetBlockHash().ToString(), GetName());
+                WaitForBlock();
+                continue;
+            }
+            SetBest(pindexNext);
+
+            if (GetTime() - nLastProgress >= CHAIN_INDEX_PROGRESS_INTERVAL) {
+                LogPrintf("Syncing the %s: height %d of %d\n", GetName(), pindexNext->nHeight, nTipHeight);
+                SaveBest();
+                nLastProgress = GetTime();
+            }
+        }
+    } catch (const boost::thread_interrupted&) {
+        SaveBest();
+        throw;
+    }
+}
@@ -0,0 +1,86 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CHAININDEX_H
+#define BITCOIN_CHAININDEX_H
+
+#include "validationinterface.h"
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+class CBlock;
+class CBlockIndex;
+struct CBlockLocator;
+
+/**
+ * Base of the optional indexes (-txindex, -addrindex) that are kept in
+ * their own database and built in the background.
+ *
+ * The indexes are not written by ConnectBlock. Instead, Thread() follows
+ * the active chain on its own, reading each block from disk, and is woken up
+ * by the validation interface when blocks are connected. A new index catches
+ * up from the genesis block while the node is in service, and the block it
+ * has reached is saved in its database, so it resumes from there after a
+ * restart. Blocks that are disconnected are handed to RewindBlock(), from the
+ * index's best block back to the fork point.
+ */
+class CChainIndex : public CValidationInterface
+{
+private:
+    //! Last block in the index, or NULL. Guarded by cs_main.
+    const CBlockIndex* pindexBest;
+    //! Whether the index has caught up with the chain since startup. Guarded by cs_main.
+    bool fSynced;
+    //! Last block in the index as saved in the database
+    const CBlockIndex* pindexSaved;
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    bool fNewBlock;
+
+    //! Signals changes of pindexBest. Must not be locked before cs_main is released.
+    boost::mutex mutexBest;
+    boost::condition_variable condBest;
+
+    void SetBest(const CBlockIndex* pindex);
+    void SaveBest();
+    void WaitForBlock();
+
+protected:
+    void SyncTransaction(const CTransaction& tx, const CBlockIndex* pindex, const CBlock* pblock);
+
+    /** Name of the index, for log messages */
+    virtual const char* GetName() const = 0;
+    virtual bool ReadBestBlock(CBlockLocator& locator) const = 0;
+    virtual bool WriteBestBlock(const CBlockLocator& locator) = 0;
+    /** Add a block of the active chain, the one after the best block. */
+    virtual bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) = 0;
+    /** Remove the best block, which is no longer in the active chain. By default its entries stay. */
+    virtual bool RewindBlock(const CBlockIndex* pindex) { return true; }
+
+public:
+    CChainIndex();
+    virtual ~CChainIndex() {}
+
+    /** Find where the index left off. Requires the block index to be loaded. */
+    bool Init();
+
+    /** Last block in the index, or NULL. Requires cs_main. */
+    const CBlockIndex* GetBestBlock() const { return pindexBest; }
+    /** Whether the index has caught up with the active chain. Requires cs_main. */
+    bool IsSynced() const;
+    /**
+     * Wait (for up to 10 seconds) until the blocks connected so far are
+     * indexed, unless the index is still catching up after startup, so that
+     * callers see transactions that were just confirmed. Must not be called
+     * with cs_main held.
+     */
+    void BlockUntilSyncedToCurrentChain();
+
+    /** Worker thread. Follows the active chain until interrupted. */
+    void Thread();
+};
+
+#endif // BITCOIN_CHAININDEX_H
@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -25,4 +26,21 @@ public:
     CSHA256& Reset();
 };
 
+/**
+ * Select the fastest SHA-256 implementations the CPU supports (SHA-NI,
+ * SSE4.1, AVX2), and check them against the portable one. Returns a
+ * description of the selection. Must be called before other threads use
+ * SHA-256.
+ */
+std::string SHA256AutoDetect();
+
+/**
+ * Compute the double SHA-256 of each of a number of 64-byte inputs, several
+ * at a time where the CPU allows. out may be equal to in.
+ * @param[out] out    blocks * 32 bytes: the hashes
+ * @param[in]  in     blocks * 64 bytes: the inputs
+ * @param[in]  blocks the number of inputs
+ */
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -0,0 +1,199 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// SHA-256 using the x86 SHA extensions (SHA-NI): the transformation, and a
+// double SHA-256 of two 64-byte inputs with their rounds interleaved. Built
+// with -msse4 -msha, and only used when SHA256AutoDetect() finds the CPU
+// supports it.
+//
+// The state is kept in two vectors as SHA256RNDS2 wants it, ABEF and CDGH,
+// and each QuadRound() does four rounds, two per SHA256RNDS2.
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+#if defined(ENABLE_SHANI)
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <immintrin.h>
+
+namespace sha256_shani
+{
+namespace
+{
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+const uint32_t INIT[8] = {0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul, 0x510e527ful, 0x9b05688cul, 0x1f83d9abul, 0x5be0cd19ul};
+
+/** Byte order of the big endian words of a 16-byte block */
+__m128i inline Mask() { return _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull); }
+
+__m128i inline Load(const unsigned char* in) { return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)in), Mask()); }
+void inline Save(unsigned char* out, __m128i v) { _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(v, Mask())); }
+
+/** Convert the state from ABCD, EFGH to ABEF, CDGH. */
+void inline Shuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0xb1);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0x1b);
+    s0 = _mm_alignr_epi8(t1, t2, 0x08);
+    s1 = _mm_blend_epi16(t2, t1, 0xf0);
+}
+
+/** Convert the state from ABEF, CDGH back to ABCD, EFGH. */
+void inline Unshuffle(__m128i& s0, __m128i& s1)
+{
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0x1b);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0xb1);
+    s0 = _mm_blend_epi16(t1, t2, 0xf0);
+    s1 = _mm_alignr_epi8(t2, t1, 0x08);
+}
+
+/** Four rounds, starting at round i, with message words m. */
+void inline QuadRound(__m128i& s0, __m128i& s1, __m128i m, int i)
+{
+    const __m128i kw = _mm_add_epi32(m, _mm_loadu_si128((const __m128i*)(K + i)));
+    s1 = _mm_sha256rnds2_epu32(s1, s0, kw);
+    s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(kw, 0x0e));
+}
+
+/** First half of the schedule of the four message words after m1 (m0 is four words before m1). */
+void inline ShiftMessageA(__m128i& m0, __m128i m1)
+{
+    m0 = _mm_sha256msg1_epu32(m0, m1);
+}
+
+/** Finish the four message words after m1, m2, that ShiftMessageA(m2, ...) started. */
+void inline ShiftMessageC(__m128i m0, __m128i m1, __m128i& m2)
+{
+    m2 = _mm_sha256msg2_epu32(_mm_add_epi32(m2, _mm_alignr_epi8(m1, m0, 4)), m1);
+}
+
+/** ShiftMessageC(), then ShiftMessageA() for the next four words. */
+void inline ShiftMessageB(__m128i& m0, __m128i m1, __m128i& m2)
+{
+    ShiftMessageC(m0, m1, m2);
+    ShiftMessageA(m0, m1);
+}
+
+/**
+ * The 64 rounds of N independent transformations, with their message words
+ * m (which are overwritten). The instructions of the lanes are interleaved,
+ * so that their latencies overlap.
+ */
+template <int N>
+void inline Rounds(__m128i (&s)[N][2], __m128i (&m)[N][4])
+{
+    for (int j = 0; j < N; j++) QuadRound(s[j][0], s[j][1], m[j][0], 0);
+    for (int j = 0; j < N; j++) QuadRound(s[j][0], s[j][1], m[j][1], 4);
+    for (int j = 0; j < N; j++) ShiftMessageA(m[j][0], m[j][1]);
+    for (int j = 0; j < N; j++) QuadRound(s[j][0], s[j][1], m[j][2], 8);
+    for (int j = 0; j < N; j++) ShiftMessageA(m[j][1], m[j][2]);
+    for (int j = 0; j < N; j++) QuadRound(s[j][0], s[j][1], m[j][3], 12);
+    for (int j = 0; j < N; j++) ShiftMessageB(m[j][2], m[j][3], m[j][0]);
+    for (int i = 16; i < 48; i += 16) {
+        for (int j = 0; j < N; j++) QuadRound(s[j][0], s[j][1], m[j][0], i);
+        for (int j = 0; j < N; j++) ShiftMessageB(m[j][3], m[j][0], m[j][1]);
+        for (int j = 0; j < N; j++) QuadRound(s[j][0], s[j][1], m[j][1], i + 4);
+        for (int j = 0; j < N; j++) ShiftMessageB(m[j][0], m[j][1], m[j][2]);
+        for (int j = 0; j < N; j++) QuadRound(s[j][0], s[j][1], m[j][2], i + 8);
+        for (int j = 0; j < N; j++) ShiftMessageB(m[j][1], m[j][2], m[j][3]);
+        for (int j = 0; j < N; j++) QuadRound(s[j][0], s[j][1], m[j][3], i + 12);
+        for (int j = 0; j < N; j++) ShiftMessageB(m[j][2], m[j][3], m[j][0]);
+    }
+    for (int j = 0; j < N; j++) QuadRound(s[j][0], s[j][1], m[j][0], 48);
+    for (int j = 0; j < N; j++) ShiftMessageB(m[j][3], m[j][0], m[j][1]);
+    for (int j = 0; j < N; j++) QuadRound(s[j][0], s[j][1], m[j][1], 52);
+    for (int j = 0; j < N; j++) ShiftMessageC(m[j][0], m[j][1], m[j][2]);
+    for (int j = 0; j < N; j++) QuadRound(s[j][0], s[j][1], m[j][2], 56);
+    for (int j = 0; j < N; j++) ShiftMessageC(m[j][1], m[j][2], m[j][3]);
+    for (int j = 0; j < N; j++) QuadRound(s[j][0], s[j][1], m[j][3], 60);
+}
+
+/** The initial state, shuffled */
+void inline Initialize(__m128i& s0, __m128i& s1)
+{
+    s0 = _mm_loadu_si128((const __m128i*)INIT);
+    s1 = _mm_loadu_si128((const __m128i*)(INIT + 4));
+    Shuffle(s0, s1);
+}
+
+} // namespace
+
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    __m128i state[1][2], m[1][4];
+    state[0][0] = _mm_loadu_si128((const __m128i*)s);
+    state[0][1] = _mm_loadu_si128((const __m128i*)(s + 4));
+    Shuffle(state[0][0], state[0][1]);
+    while (blocks--) {
+        const __m128i s0 = state[0][0], s1 = state[0][1];
+        for (int i = 0; i < 4; i++)
+            m[0][i] = Load(chunk + 16 * i);
+        Rounds(state, m);
+        state[0][0] = _mm_add_epi32(state[0][0], s0);
+        state[0][1] = _mm_add_epi32(state[0][1], s1);
+        chunk += 64;
+    }
+    Unshuffle(state[0][0], state[0][1]);
+    _mm_storeu_si128((__m128i*)s, state[0][0]);
+    _mm_storeu_si128((__m128i*)(s + 4), state[0][1]);
+}
+
+void TransformD64_2way(unsigned char* out, const unsigned char* in)
+{
+    __m128i s[2][2], t[2][2], m[2][4], init0, init1;
+    Initialize(init0, init1);
+
+    // First hash: the input, then a block of padding
+    for (int j = 0; j < 2; j++) {
+        s[j][0] = init0;
+        s[j][1] = init1;
+        for (int i = 0; i < 4; i++)
+            m[j][i] = Load(in + 64 * j + 16 * i);
+    }
+    Rounds(s, m);
+    for (int j = 0; j < 2; j++) {
+        s[j][0] = t[j][0] = _mm_add_epi32(s[j][0], init0);
+        s[j][1] = t[j][1] = _mm_add_epi32(s[j][1], init1);
+        m[j][0] = _mm_set_epi32(0, 0, 0, (int)0x80000000);
+        m[j][1] = _mm_setzero_si128();
+        m[j][2] = _mm_setzero_si128();
+        m[j][3] = _mm_set_epi32(512, 0, 0, 0);
+    }
+    Rounds(s, m);
+
+    // Second hash, of the 32-byte result: its words are the state words
+    for (int j = 0; j < 2; j++) {
+        m[j][0] = _mm_add_epi32(s[j][0], t[j][0]);
+        m[j][1] = _mm_add_epi32(s[j][1], t[j][1]);
+        Unshuffle(m[j][0], m[j][1]);
+        m[j][2] = _mm_set_epi32(0, 0, 0, (int)0x80000000);
+        m[j][3] = _mm_set_epi32(256, 0, 0, 0);
+        s[j][0] = init0;
+        s[j][1] = init1;
+    }
+    Rounds(s, m);
+    for (int j = 0; j < 2; j++) {
+        s[j][0] = _mm_add_epi32(s[j][0], init0);
+        s[j][1] = _mm_add_epi32(s[j][1], init1);
+        Unshuffle(s[j][0], s[j][1]);
+        Save(out + 32 * j, s[j][0]);
+        Save(out + 32 * j + 16, s[j][1]);
+    }
+}
+
+} // namespace sha256_shani
+
+#endif
@@ -7,7 +7,16 @@
 #include "util.h"
 #include "random.h"
 
+#include <algorithm>
+#include <sstream>
+#include <stdio.h>
+
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/unordered_map.hpp>
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
@@ -15,12 +24,63 @@
 #include <memenv.h>
 #include <stdint.h>
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+/**
+ * A batch being written by a background thread, with an index of its
+ * contents so that reads can be served from it until LevelDB has it.
+ */
+class CDBAsyncWriter : public leveldb::WriteBatch::Handler
+{
+public:
+    //! Protects the members below, except thread (only used by the writing side)
+    boost::mutex cs;
+    //! The batch being written, or NULL
+    leveldb::WriteBatch* pbatch;
+    bool fSync;
+    //! Keys in pbatch, with the last value for each (pointing into pbatch) or whether it is erased
+    boost::unordered_map<std::string, std::pair<bool, leveldb::Slice> > mapPending;
+    //! Why writing pbatch failed, if it did
+    leveldb::Status status;
+
+    //! Serializes waiting for and starting the thread
+    boost::mutex csThread;
+    boost::scoped_ptr<boost::thread> thread;
+
+    CDBAsyncWriter() : pbatch(NULL), fSync(false) {}
+    ~CDBAsyncWriter() { delete pbatch; }
+
+    void Put(const leveldb::Slice& key, const leveldb::Slice& value)
+    {
+        mapPending[key.ToString()] = std::make_pair(false, value);
+    }
+
+    void Delete(const leveldb::Slice& key)
+    {
+        mapPending[key.ToString()] = std::make_pair(true, leveldb::Slice());
+    }
+};
+
+CDBTuning::CDBTuning(size_t nCacheSize) :
+    nBlockCache(nCacheSize / 2),
+    nWriteBuffer(nCacheSize / 4), // up to two write buffers may be held in memory simultaneously
+    nBloomBits(10)
+{
+}
+
+CDBTuning GetDBTuning(const std::string& strName, size_t nCacheSize)
+{
+    CDBTuning tuning(nCacheSize);
+    tuning.nBlockCache = std::max<int64_t>(0, GetArg("-" + strName + "dbblockcache", tuning.nBlockCache >> 20) << 20);
+    tuning.nWriteBuffer = std::max<int64_t>(1, GetArg("-" + strName + "dbwritebuffer", tuning.nWriteBuffer >> 20) << 20);
+    tuning.nBloomBits = std::max<int64_t>(0, GetArg("-" + strName + "dbbloombits", tuning.nBloomBits));
+    return tuning;
+}
+
+static leveldb::Options GetOptions(const CDBTuning& tuning)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+    options.block_cache = leveldb::NewLRUCache(tuning.nBlockCache);
+    options.write_buffer_size = tuning.nWriteBuffer;
+    options.filter_policy = tuning.nBloomBits > 0 ? leveldb::NewBloomFilterPolicy(tuning.nBloomBits) : NULL;
     options.compression = leveldb::kNoCompression;
     options.max_open_files = 64;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
@@ -31,14 +91,15 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+CDBWrapper::CDBWrapper(const boost::filesystem::path& path, const CDBTuning& tuningIn, bool fMemory, bool fWipe, bool obfuscate) : tuning(tuningIn)
 {
     penv = NULL;
+    pasync = new CDBAsyncWriter();
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(tuning);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -51,6 +112,8 @@ CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, b
         }
         TryCreateDirectory(path);
         LogPrintf("Opening LevelDB in %s\n", path.string());
+        LogPrint("db", "LevelDB block cache %.1fMiB, write buffer %.1fMiB, %d bloom filter bits\n",
+            tuning.nBlockCache * (1.0 / 1024 / 1024), tuning.nWriteBuffer * (1.0 / 1024 / 1024), tuning.nBloomBits);
     }
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
@@ -78,6 +141,13 @@ CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, b
 
 CDBWrapper::~CDBWrapper()
 {
+    try {
+        WaitForWrites();
+    } catch (const dbwrapper_error&) {
+        // Already logged
+    }
+    delete pasync;
+    pasync = NULL;
     delete pdb;
     pdb = NULL;
     delete options.filter_policy;
@@ -90,11 +160,83 @@ CDBWrapper::~CDBWrapper()
 
 bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
 {
-    leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
+    WaitForWrites();
+    leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, batch.pbatch);
     dbwrapper_private::HandleError(status);
     return true;
 }
 
+void CDBWrapper::WriteBatchAsync(CDBBatch& batch, bool fSync)
+{
+    WaitForWrites();
+    boost::unique_lock<boost::mutex> lockThread(pasync->csThread);
+    {
+        boost::unique_lock<boost::mutex> lock(pasync->cs);
+        assert(!pasync->pbatch);
+        pasync->pbatch = batch.pbatch;
+        pasync->fSync = fSync;
+        batch.pbatch = new leveldb::WriteBatch();
+        leveldb::Status status = pasync->pbatch->Iterate(pasync);
+        assert(status.ok());
+    }
+    pasync->thread.reset(new boost::thread(boost::bind(&CDBWrapper::ThreadAsyncWrite, this)));
+}
+
+void CDBWrapper::ThreadAsyncWrite()
+{
+    RenameThread("bitcoin-dbwrite");
+    // Only this thread changes pbatch while it runs.
+    leveldb::Status status = pdb->Write(pasync->fSync ? syncoptions : writeoptions, pasync->pbatch);
+    if (!status.ok())
+        LogPrintf("LevelDB background write failure: %s\n", status.ToString());
+
+    boost::unique_lock<boost::mutex> lock(pasync->cs);
+    if (status.ok()) {
+        pasync->mapPending.clear();
+        delete pasync->pbatch;
+        pasync->pbatch = NULL;
+    } else {
+        pasync->status = status;
+    }
+}
+
+void CDBWrapper::WaitForWrites()
+{
+    boost::this_thread::disable_interruption di;
+    boost::unique_lock<boost::mutex> lockThread(pasync->csThread);
+    if (pasync->thread) {
+        pasync->thread->join();
+        pasync->thread.reset();
+    }
+    boost::unique_lock<boost::mutex> lock(pasync->cs);
+    dbwrapper_private::HandleError(pasync->status);
+}
+
+bool CDBWrapper::ReadRaw(const leveldb::Slice& slKey, std::string& strValue) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(pasync->cs);
+        if (pasync->pbatch) {
+            boost::unordered_map<std::string, std::pair<bool, leveldb::Slice> >::const_iterator it = pasync->mapPending.find(slKey.ToString());
+            if (it != pasync->mapPending.end()) {
+                if (it->second.first)
+                    return false;
+                strValue.assign(it->second.second.data(), it->second.second.size());
+                return true;
+            }
+        }
+    }
+
+    leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+    if (!status.ok()) {
+        if (status.IsNotFound())
+            return false;
+        LogPrintf("LevelDB read failure: %s\n", status.ToString());
+        dbwrapper_private::HandleError(status);
+    }
+    return true;
+}
+
 // Prefixed with null character to avoid collisions with other keys
 //
 // We must use a string constructor which specifies length so that we copy
@@ -122,6 +264,29 @@ bool CDBWrapper::IsEmpty()
     return !(it->Valid());
 }
 
+void CDBWrapper::GetStats(CDBStats& stats) const
+{
+    // All keys sort before a single 0xff byte.
+    leveldb::Range range("", "\xff");
+    stats.nApproximateSize = 0;
+    pdb->GetApproximateSizes(&range, 1, &stats.nApproximateSize);
+
+    stats.strStats.clear();
+    stats.vLevels.clear();
+    if (!pdb->GetProperty("leveldb.stats", &stats.strStats))
+        return;
+    // After a header, one line per non-empty level:
+    // Level Files Size(MB) Time(sec) Read(MB) Write(MB)
+    std::istringstream ss(stats.strStats);
+    std::string strLine;
+    while (std::getline(ss, strLine)) {
+        CDBLevelStats level;
+        if (sscanf(strLine.c_str(), "%d %d %lf %lf %lf %lf", &level.nLevel, &level.nFiles, &level.dSize,
+                &level.dCompactionTime, &level.dCompactionRead, &level.dCompactionWrite) == 6)
+            stats.vLevels.push_back(level);
+    }
+}
+
 CDBIterator::~CDBIterator() { delete piter; }
 bool CDBIterator::Valid() { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
@@ -23,8 +23,45 @@ public:
     dbwrapper_error(const std::string& msg) : std::runtime_error(msg) {}
 };
 
+class CDBAsyncWriter;
 class CDBWrapper;
 
+/** LevelDB settings of a database */
+struct CDBTuning
+{
+    size_t nBlockCache;  //!< Size of the block cache, in bytes
+    size_t nWriteBuffer; //!< Size of the write buffer, in bytes. Up to two may be held in memory at once.
+    int nBloomBits;      //!< Bloom filter bits per key, or 0 for no filter
+
+    /** Use half of nCacheSize for the block cache and a quarter for the write buffer, with 10 bit bloom filters. */
+    CDBTuning(size_t nCacheSize = 0);
+};
+
+/**
+ * Get the tuning for the database named strName, starting from the defaults
+ * for nCacheSize and applying -<name>dbblockcache, -<name>dbwritebuffer and
+ * -<name>dbbloombits.
+ */
+CDBTuning GetDBTuning(const std::string& strName, size_t nCacheSize);
+
+/** Statistics of one level of a database, from LevelDB's compaction stats */
+struct CDBLevelStats
+{
+    int nLevel;
+    int nFiles;
+    double dSize;           //!< MB in this level
+    double dCompactionTime; //!< Seconds spent on compactions into this level
+    double dCompactionRead; //!< MB read by those compactions
+    double dCompactionWrite; //!< MB written by those compactions
+};
+
+struct CDBStats
+{
+    uint64_t nApproximateSize; //!< Approximate size of all data on disk, in bytes
+    std::vector<CDBLevelStats> vLevels;
+    std::string strStats;      //!< LevelDB's own report
+};
+
 /** These should be considered an implementation detail of the specific database.
  */
 namespace dbwrapper_private {
@@ -48,13 +85,17 @@ class CDBBatch
 
 private:
     const CDBWrapper &parent;
-    leveldb::WriteBatch batch;
+    leveldb::WriteBatch* pbatch; //!< On the heap, so that CDBWrapper::WriteBatchAsync can take it over
+
+    CDBBatch(const CDBBatch&);
+    void operator=(const CDBBatch&);
 
 public:
     /**
      * @param[in] parent    CDBWrapper that this batch is to be submitted to
      */
-    CDBBatch(const CDBWrapper &parent) : parent(parent) { };
+    CDBBatch(const CDBWrapper &parent) : parent(parent), pbatch(new leveldb::WriteBatch) { };
+    ~CDBBatch() { delete pbatch; }
 
     template <typename K, typename V>
     void Write(const K& key, const V& value)
@@ -70,7 +111,7 @@ public:
         ssValue.Xor(dbwrapper_private::GetObfuscateKey(parent));
         leveldb::Slice slValue(&ssValue[0], ssValue.size());
 
-        batch.Put(slKey, slValue);
+        pbatch->Put(slKey, slValue);
     }
 
     template <typename K>
@@ -81,7 +122,7 @@ public:
         ssKey << key;
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
-        batch.Delete(slKey);
+        pbatch->Delete(slKey);
     }
 };
 
@@ -158,6 +199,9 @@ private:
     //! database options used
     leveldb::Options options;
 
+    //! the settings these options were made from
+    CDBTuning tuning;
+
     //! options used when reading from the database
     leveldb::ReadOptions readoptions;
 
@@ -184,16 +228,24 @@ private:
 
     std::vector<unsigned char> CreateObfuscateKey() const;
 
+    //! the batch being written in the background, if any (see WriteBatchAsync)
+    CDBAsyncWriter* pasync;
+
+    /** Look up a raw (still obfuscated) value, including in a batch being written in the background. */
+    bool ReadRaw(const leveldb::Slice& slKey, std::string& strValue) const;
+    void ThreadAsyncWrite();
+
 public:
     /**
      * @param[in] path        Location in the filesystem where leveldb data will be stored.
-     * @param[in] nCacheSize  Configures various leveldb cache settings.
+     * @param[in] tuning      LevelDB cache and filter settings. A cache size
+     *                        converts to the default settings for it.
      * @param[in] fMemory     If true, use leveldb's memory environment.
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
      */
-    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const boost::filesystem::path& path, const CDBTuning& tuning, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
     ~CDBWrapper();
 
     template <typename K, typename V>
@@ -205,13 +257,8 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
-        if (!status.ok()) {
-            if (status.IsNotFound())
-                return false;
-            LogPrintf("LevelDB read failure: %s\n", status.ToString());
-            dbwrapper_private::HandleError(status);
-        }
+        if (!ReadRaw(slKey, strValue))
+            return false;
         try {
             CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
             ssValue.Xor(obfuscate_key);
@@ -239,14 +286,7 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
-        if (!status.ok()) {
-            if (status.IsNotFound())
-                return false;
-            LogPrintf("LevelDB read failure: %s\n", status.ToString());
-            dbwrapper_private::HandleError(status);
-        }
-        return true;
+        return ReadRaw(slKey, strValue);
     }
 
     template <typename K>
@@ -259,6 +299,21 @@ public:
 
     bool WriteBatch(CDBBatch& batch, bool fSync = false);
 
+    /**
+     * Hand the contents of batch over to a background thread to be written,
+     * and return without waiting for LevelDB. Reads see the new contents
+     * right away. Only one batch is written at a time, so this first waits
+     * for the previous one; so do WriteBatch and NewIterator.
+     */
+    void WriteBatchAsync(CDBBatch& batch, bool fSync = false);
+
+    /**
+     * Wait until the batch given to WriteBatchAsync, if any, is written.
+     * Throws dbwrapper_error if writing it failed; the batch then stays
+     * visible to reads, but nothing more can be written.
+     */
+    void WaitForWrites();
+
     // not available for LevelDB; provide for compatibility with BDB
     bool Flush()
     {
@@ -273,6 +328,7 @@ public:
 
     CDBIterator *NewIterator()
     {
+        WaitForWrites();
         return new CDBIterator(*this, pdb->NewIterator(iteroptions));
     }
 
@@ -280,6 +336,11 @@ public:
      * Return true if the database managed by this class contains no entries.
      */
     bool IsEmpty();
+
+    const CDBTuning& GetTuning() const { return tuning; }
+
+    /** Get LevelDB's statistics and the approximate size of the database. */
+    void GetStats(CDBStats& stats) const;
 };
 
 #endif // BITCOIN_DBWRAPPER_H
@@ -0,0 +1,119 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_FLATSET_H
+#define BITCOIN_FLATSET_H
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+/** STL-like set container that keeps its elements in a single sorted vector.
+ *
+ *  Compared to std::set, lookups are a binary search over contiguous memory
+ *  and a set costs one allocation in total instead of one per element (none
+ *  at all while empty). Single-element inserts and erases are linear in the
+ *  size of the set, so this is meant for small sets; use the range insert()
+ *  to add many elements at once, which sorts and merges them in one pass.
+ *
+ *  Iteration order is the same as that of std::set<K, Compare>.
+ */
+template <typename K, typename Compare = std::less<K> >
+class flatset
+{
+public:
+    typedef K key_type;
+    typedef K value_type;
+    typedef Compare key_compare;
+    typedef typename std::vector<K>::const_iterator const_iterator;
+    typedef const_iterator iterator;
+    typedef typename std::vector<K>::size_type size_type;
+
+protected:
+    std::vector<K> vec;
+    Compare comp;
+
+    typename std::vector<K>::iterator lower_bound_mutable(const key_type& k)
+    {
+        return std::lower_bound(vec.begin(), vec.end(), k, comp);
+    }
+
+public:
+    flatset() {}
+    template <typename InputIterator>
+    flatset(InputIterator first, InputIterator last) { insert(first, last); }
+
+    const_iterator begin() const { return vec.begin(); }
+    const_iterator end() const { return vec.end(); }
+    size_type size() const { return vec.size(); }
+    bool empty() const { return vec.empty(); }
+    size_type capacity() const { return vec.capacity(); }
+    void reserve(size_type n) { vec.reserve(n); }
+    void clear() { vec.clear(); }
+    void swap(flatset& other) { vec.swap(other.vec); std::swap(comp, other.comp); }
+
+    const_iterator lower_bound(const key_type& k) const
+    {
+        return std::lower_bound(vec.begin(), vec.end(), k, comp);
+    }
+
+    const_iterator find(const key_type& k) const
+    {
+        const_iterator it = lower_bound(k);
+        if (it != vec.end() && !comp(k, *it))
+            return it;
+        return vec.end();
+    }
+
+    size_type count(const key_type& k) const { return find(k) == vec.end() ? 0 : 1; }
+
+    std::pair<const_iterator, bool> insert(const value_type& x)
+    {
+        typename std::vector<K>::iterator it = lower_bound_mutable(x);
+        if (it != vec.end() && !comp(x, *it))
+            return std::make_pair(const_iterator(it), false);
+        return std::make_pair(const_iterator(vec.insert(it, x)), true);
+    }
+
+    /** Insert a range of elements, in any order and possibly with duplicates. */
+    template <typename InputIterator>
+    void insert(InputIterator first, InputIterator last)
+    {
+        size_type nOld = vec.size();
+        vec.insert(vec.end(), first, last);
+        if (vec.size() == nOld)
+            return;
+        std::sort(vec.begin() + nOld, vec.end(), comp);
+        std::inplace_merge(vec.begin(), vec.begin() + nOld, vec.end(), comp);
+        vec.erase(std::unique(vec.begin(), vec.end(), equivalent(comp)), vec.end());
+    }
+
+    size_type erase(const key_type& k)
+    {
+        typename std::vector<K>::iterator it = lower_bound_mutable(k);
+        if (it == vec.end() || comp(k, *it))
+            return 0;
+        vec.erase(it);
+        return 1;
+    }
+
+    void erase(const_iterator it)
+    {
+        vec.erase(vec.begin() + (it - begin()));
+    }
+
+    bool operator==(const flatset& other) const { return vec == other.vec; }
+    bool operator!=(const flatset& other) const { return vec != other.vec; }
+
+private:
+    struct equivalent
+    {
+        Compare comp;
+        equivalent(const Compare& c) : comp(c) {}
+        bool operator()(const K& a, const K& b) const { return !comp(a, b) && !comp(b, a); }
+    };
+};
+
+#endif // BITCOIN_FLATSET_H
@@ -9,13 +9,16 @@
 
 #include "init.h"
 
+#include "addrindex.h"
 #include "addrman.h"
 #include "amount.h"
+#include "blockcache.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "consensus/validation.h"
+#include "crypto/sha256.h"
 #include "httpserver.h"
 #include "httprpc.h"
 #include "key.h"
@@ -30,7 +33,9 @@
 #include "scheduler.h"
 #include "timedata.h"
 #include "txdb.h"
+#include "txindex.h"
 #include "txmempool.h"
+#include "txmempooloverflow.h"
 #include "torcontrol.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -92,6 +97,7 @@ enum BindFlags {
 };
 
 static const char* FEE_ESTIMATES_FILENAME="fee_estimates.dat";
+static const char* MEMPOOL_OVERFLOW_FILENAME="mempool_overflow.dat";
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -159,7 +165,6 @@ public:
     // Writes do not need similar protection, as failure to write is handled by the caller.
 };
 
-static CCoinsViewDB *pcoinsdbview = NULL;
 static CCoinsViewErrorCatcher *pcoinscatcher = NULL;
 static boost::scoped_ptr<ECCVerifyHandle> globalVerifyHandle;
 
@@ -210,6 +215,7 @@ void Shutdown()
             LogPrintf("%s: Failed to write fee estimates to %s\n", __func__, est_path.string());
         fFeeEstimatesInitialized = false;
     }
+    mempoolOverflow.Close();
 
     {
         LOCK(cs_main);
@@ -225,6 +231,16 @@ void Shutdown()
         delete pblocktree;
         pblocktree = NULL;
     }
+    if (ptxindex) {
+        UnregisterValidationInterface(ptxindex);
+        delete ptxindex;
+        ptxindex = NULL;
+    }
+    if (paddrindex) {
+        UnregisterValidationInterface(paddrindex);
+        delete paddrindex;
+        paddrindex = NULL;
+    }
 #ifdef ENABLE_WALLET
     if (pwalletMain)
         pwalletMain->Flush(true);
@@ -304,12 +320,15 @@ std::string HelpMessage(HelpMessageMode mode)
     string strUsage = HelpMessageGroup(_("Options:"));
     strUsage += HelpMessageOpt("-?", _("Print this help message and exit"));
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
+    strUsage += HelpMessageOpt("-addrindex", strprintf(_("Maintain an index of all outputs by address, used by the getaddressoutputs rpc call, and build it in the background if needed (default: %u)"), DEFAULT_ADDRINDEX));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
+    strUsage += HelpMessageOpt("-blockcache=<n>", strprintf(_("Keep up to <n> megabytes of recently received and connected blocks in memory (0 to disable, default: %u)"), DEFAULT_BLOCK_CACHE_SIZE));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), DEFAULT_CHECKBLOCKS));
     strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), DEFAULT_CHECKLEVEL));
+    strUsage += HelpMessageOpt("-coinsfilter=<n>", strprintf(_("Use <n> megabytes for a filter that avoids disk lookups of transactions not in the UTXO set, 0 to disable (default: %u)"), DEFAULT_COINS_FILTER_SIZE));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), BITCOIN_CONF_FILENAME));
     if (mode == HMM_BITCOIND)
     {
@@ -321,15 +340,16 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
     strUsage += HelpMessageOpt("-feefilter", strprintf(_("Tell other nodes to filter invs to us by our mempool min fee (default: %u)"), DEFAULT_FEEFILTER));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
-    strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+    strUsage += HelpMessageOpt("-maxorphantxsize=<n>", strprintf(_("Keep at most <n> megabytes of unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TX_SIZE));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
+    strUsage += HelpMessageOpt("-maxmempooloverflow=<n>", strprintf(_("Keep up to <n> megabytes of transactions evicted from a full mempool on disk, and re-add them once there is room (0 to disable, at most %u, default: %u)"), MAX_MEMPOOL_OVERFLOW_SIZE, DEFAULT_MAX_MEMPOOL_OVERFLOW_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), BITCOIN_PID_FILENAME));
 #endif
-    strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by pruning (deleting) old blocks. This mode is incompatible with -txindex and -rescan. "
+    strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by pruning (deleting) old blocks. This mode is incompatible with -txindex, -addrindex and -rescan. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
             "(default: 0 = disable pruning blocks, >%u = target size in MiB to use for block files)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
     strUsage += HelpMessageOpt("-reindex-chainstate", _("Rebuild chain state from the currently indexed blocks"));
@@ -337,7 +357,7 @@ std::string HelpMessage(HelpMessageMode mode)
 #ifndef WIN32
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
-    strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
+    strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call, and build it in the background if needed (default: %u)"), DEFAULT_TXINDEX));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open"));
@@ -400,6 +420,18 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", DEFAULT_CHECKPOINTS_ENABLED));
+        strUsage += HelpMessageOpt("-chainstatedbblockcache=<n>", "Set the LevelDB block cache of the chain state database in megabytes (default: half of its share of -dbcache)");
+        strUsage += HelpMessageOpt("-chainstatedbwritebuffer=<n>", "Set the LevelDB write buffer of the chain state database in megabytes (default: a quarter of its share of -dbcache)");
+        strUsage += HelpMessageOpt("-chainstatedbbloombits=<n>", "Set the LevelDB bloom filter bits per key of the chain state database, 0 to disable (default: 10)");
+        strUsage += HelpMessageOpt("-blockindexdbblockcache=<n>", "Set the LevelDB block cache of the block index database in megabytes (default: half of its share of -dbcache)");
+        strUsage += HelpMessageOpt("-blockindexdbwritebuffer=<n>", "Set the LevelDB write buffer of the block index database in megabytes (default: a quarter of its share of -dbcache)");
+        strUsage += HelpMessageOpt("-blockindexdbbloombits=<n>", "Set the LevelDB bloom filter bits per key of the block index database, 0 to disable (default: 10)");
+        strUsage += HelpMessageOpt("-txindexdbblockcache=<n>", "Set the LevelDB block cache of the transaction index database in megabytes (default: half of its share of -dbcache)");
+        strUsage += HelpMessageOpt("-txindexdbwritebuffer=<n>", "Set the LevelDB write buffer of the transaction index database in megabytes (default: a quarter of its share of -dbcache)");
+        strUsage += HelpMessageOpt("-txindexdbbloombits=<n>", "Set the LevelDB bloom filter bits per key of the transaction index database, 0 to disable (default: 10)");
+        strUsage += HelpMessageOpt("-addrindexdbblockcache=<n>", "Set the LevelDB block cache of the address index database in megabytes (default: half of its share of -dbcache)");
+        strUsage += HelpMessageOpt("-addrindexdbwritebuffer=<n>", "Set the LevelDB write buffer of the address index database in megabytes (default: a quarter of its share of -dbcache)");
+        strUsage += HelpMessageOpt("-addrindexdbbloombits=<n>", "Set the LevelDB bloom filter bits per key of the address index database, 0 to disable (default: 10)");
         strUsage += HelpMessageOpt("-disablesafemode", strprintf("Disable safemode, override a real safe mode event (default: %u)", DEFAULT_DISABLE_SAFEMODE));
         strUsage += HelpMessageOpt("-testsafemode", strprintf("Force safe mode (default: %u)", DEFAULT_TESTSAFEMODE));
         strUsage += HelpMessageOpt("-dropmessagestest=<n>", "Randomly drop 1 of every <n> network messages");
@@ -816,10 +848,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     // also see: InitParameterInteraction()
 
-    // if using block pruning, then disable txindex
+    // if using block pruning, then disable txindex and addrindex
     if (GetArg("-prune", 0)) {
         if (GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(_("Prune mode is incompatible with -txindex."));
+        if (GetBoolArg("-addrindex", DEFAULT_ADDRINDEX))
+            return InitError(_("Prune mode is incompatible with -addrindex."));
 #ifdef ENABLE_WALLET
         if (GetBoolArg("-rescan", false)) {
             return InitError(_("Rescans are not possible in pruned mode. You will need to use -reindex which will download the whole blockchain again."));
@@ -873,6 +907,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
     fCheckBlockIndex = GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled = GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+    fTxIndex = GetBoolArg("-txindex", DEFAULT_TXINDEX);
+    bool fAddrIndex = GetBoolArg("-addrindex", DEFAULT_ADDRINDEX);
 
     // mempool limits
     int64_t nMempoolSizeMax = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
@@ -964,6 +1000,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     // ********************************************************* Step 4: application initialization: dir lock, daemonize, pidfile, debug log
 
+    std::string sha256_algo = SHA256AutoDetect();
+    LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+
     // Initialize elliptic curve code
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1010,6 +1049,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             threadGroup.create_thread(&ThreadScriptCheck);
     }
 
+    // Start the thread writing block and undo files
+    threadGroup.create_thread(&ThreadBlockFileWriter);
+
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
     threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
@@ -1204,17 +1246,26 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     int64_t nTotalCache = (GetArg("-dbcache", nDefaultDbCache) << 20);
     nTotalCache = std::max(nTotalCache, nMinDbCache << 20); // total cache cannot be less than nMinDbCache
     nTotalCache = std::min(nTotalCache, nMaxDbCache << 20); // total cache cannot be greated than nMaxDbcache
-    int64_t nBlockTreeDBCache = nTotalCache / 8;
-    if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", DEFAULT_TXINDEX))
-        nBlockTreeDBCache = (1 << 21); // block tree db cache shouldn't be larger than 2 MiB
+    int64_t nBlockTreeDBCache = std::min(nTotalCache / 8, (int64_t)1 << 21); // block tree db cache shouldn't be larger than 2 MiB
     nTotalCache -= nBlockTreeDBCache;
+    int64_t nTxIndexCache = fTxIndex ? nTotalCache / 8 : 0;
+    nTotalCache -= nTxIndexCache;
+    int64_t nAddrIndexCache = fAddrIndex ? nTotalCache / 8 : 0;
+    nTotalCache -= nAddrIndexCache;
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    if (fTxIndex)
+        LogPrintf("* Using %.1fMiB for transaction index database\n", nTxIndexCache * (1.0 / 1024 / 1024));
+    if (fAddrIndex)
+        LogPrintf("* Using %.1fMiB for address index database\n", nAddrIndexCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
+    int64_t nBlockCacheSize = std::max(GetArg("-blockcache", DEFAULT_BLOCK_CACHE_SIZE), (int64_t)0) * 1000000;
+    blockcache.SetMaxUsage(nBlockCacheSize);
+    LogPrintf("* Using %.1fMiB for recent blocks\n", nBlockCacheSize * (1.0 / 1024 / 1024));
 
     bool fLoaded = false;
     while (!fLoaded) {
@@ -1232,8 +1283,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 delete pcoinscatcher;
                 delete pblocktree;
 
-                pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
-                pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex || fReindexChainState);
+                pblocktree = new CBlockTreeDB(GetDBTuning("blockindex", nBlockTreeDBCache), false, fReindex);
+                pcoinsdbview = new CCoinsViewDB(GetDBTuning("chainstate", nCoinDBCache), false, fReindex || fReindexChainState);
+                pcoinsdbview->SetFilterSize(std::max<int64_t>(0, GetArg("-coinsfilter", DEFAULT_COINS_FILTER_SIZE)) << 20);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
 
@@ -1260,12 +1312,6 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
-                // Check for changed -txindex state
-                if (fTxIndex != GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
-                    strLoadError = _("You need to rebuild the database using -reindex-chainstate to change -txindex");
-                    break;
-                }
-
                 // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
                 // in the past, but is now trying to run unpruned.
                 if (fHavePruned && !fPruneMode) {
@@ -1333,6 +1379,32 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
     LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
 
+    // The transaction and address indexes catch up with the chain in the background
+    if (fTxIndex) {
+        try {
+            ptxindex = new CTxIndex(GetDBTuning("txindex", nTxIndexCache), false, fReindex);
+        } catch (const std::exception& e) {
+            if (fDebug) LogPrintf("%s\n", e.what());
+            return InitError(_("Error opening transaction index database"));
+        }
+        ptxindex->Init();
+        RegisterValidationInterface(ptxindex);
+        threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "txindex",
+            boost::function<void()>(boost::bind(&CTxIndex::Thread, ptxindex))));
+    }
+    if (fAddrIndex) {
+        try {
+            paddrindex = new CAddrIndex(GetDBTuning("addrindex", nAddrIndexCache), false, fReindex);
+        } catch (const std::exception& e) {
+            if (fDebug) LogPrintf("%s\n", e.what());
+            return InitError(_("Error opening address index database"));
+        }
+        paddrindex->Init();
+        RegisterValidationInterface(paddrindex);
+        threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "addrindex",
+            boost::function<void()>(boost::bind(&CAddrIndex::Thread, paddrindex))));
+    }
+
     boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fopen(est_path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
@@ -1340,6 +1412,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         mempool.ReadFeeEstimates(est_filein);
     fFeeEstimatesInitialized = true;
 
+    int64_t nMempoolOverflowSize = GetArg("-maxmempooloverflow", DEFAULT_MAX_MEMPOOL_OVERFLOW_SIZE);
+    if (nMempoolOverflowSize > 0)
+        mempoolOverflow.Open(GetDataDir() / MEMPOOL_OVERFLOW_FILENAME, nMempoolOverflowSize * 1000000);
+
     // ********************************************************* Step 8: load wallet
 #ifdef ENABLE_WALLET
     if (fDisableWallet) {
@@ -10,6 +10,8 @@
 #include <string.h>
 
 #include <iterator>
+#include <stdexcept>
+#include <type_traits>
 
 #pragma pack(push, 1)
 /** Implements a drop-in replacement for std::vector<T> which stores up to N
@@ -187,16 +189,37 @@ private:
     T* item_ptr(difference_type pos) { return is_direct() ? direct_ptr(pos) : indirect_ptr(pos); }
     const T* item_ptr(difference_type pos) const { return is_direct() ? direct_ptr(pos) : indirect_ptr(pos); }
 
+    /* Construct elements at dst, without going through item_ptr() for each
+     * one, so that for bytes the compiler turns these into memset/memcpy. */
+    void fill(T* dst, difference_type count, const T& value) {
+        for (difference_type i = 0; i < count; i++) {
+            new(static_cast<void*>(dst + i)) T(value);
+        }
+    }
+
+    void fill(T* dst, difference_type count) {
+        for (difference_type i = 0; i < count; i++) {
+            new(static_cast<void*>(dst + i)) T();
+        }
+    }
+
+    template<typename InputIterator>
+    void fill_from(T* dst, InputIterator first, InputIterator last) {
+        while (first != last) {
+            new(static_cast<void*>(dst)) T(*first);
+            ++dst;
+            ++first;
+        }
+    }
+
 public:
     void assign(size_type n, const T& val) {
         clear();
         if (capacity() < n) {
             change_capacity(n);
         }
-        while (size() < n) {
-            _size++;
-            new(static_cast<void*>(item_ptr(size() - 1))) T(val);
-        }
+        _size += n;
+        fill(item_ptr(0), n, val);
     }
 
     template<typename InputIterator>
@@ -206,11 +229,8 @@ public:
         if (capacity() < n) {
             change_capacity(n);
         }
-        while (first != last) {
-            _size++;
-            new(static_cast<void*>(item_ptr(size() - 1))) T(*first);
-            ++first;
-        }
+        _size += n;
+        fill_from(item_ptr(0), first, last);
     }
 
     prevector() : _size(0) {}
@@ -219,47 +239,32 @@ public:
         resize(n);
     }
 
-    explicit prevector(size_type n, const T& val = T()) : _size(0) {
+    explicit prevector(size_type n, const T& val) : _size(0) {
         change_capacity(n);
-        while (size() < n) {
-            _size++;
-            new(static_cast<void*>(item_ptr(size() - 1))) T(val);
-        }
+        _size += n;
+        fill(item_ptr(0), n, val);
     }
 
     template<typename InputIterator>
     prevector(InputIterator first, InputIterator last) : _size(0) {
         size_type n = last - first;
         change_capacity(n);
-        while (first != last) {
-            _size++;
-            new(static_cast<void*>(item_ptr(size() - 1))) T(*first);
-            ++first;
-        }
+        _size += n;
+        fill_from(item_ptr(0), first, last);
     }
 
     prevector(const prevector<N, T, Size, Diff>& other) : _size(0) {
-        change_capacity(other.size());
-        const_iterator it = other.begin();
-        while (it != other.end()) {
-            _size++;
-            new(static_cast<void*>(item_ptr(size() - 1))) T(*it);
-            ++it;
-        }
+        size_type n = other.size();
+        change_capacity(n);
+        _size += n;
+        fill_from(item_ptr(0), other.begin(), other.end());
     }
 
     prevector& operator=(const prevector<N, T, Size, Diff>& other) {
         if (&other == this) {
             return *this;
         }
-        resize(0);
-        change_capacity(other.size());
-        const_iterator it = other.begin();
-        while (it != other.end()) {
-            _size++;
-            new(static_cast<void*>(item_ptr(size() - 1))) T(*it);
-            ++it;
-        }
+        assign(other.begin(), other.end());
         return *this;
     }
 
@@ -297,6 +302,20 @@ public:
         return *item_ptr(pos);
     }
 
+    T& at(size_type pos) {
+        if (pos >= size()) {
+            throw std::out_of_range("prevector::at");
+        }
+        return *item_ptr(pos);
+    }
+
+    const T& at(size_type pos) const {
+        if (pos >= size()) {
+            throw std::out_of_range("prevector::at");
+        }
+        return *item_ptr(pos);
+    }
+
     void resize(size_type new_size) {
         if (size() > new_size) {
             erase(item_ptr(new_size), end());
@@ -304,9 +323,10 @@ public:
         if (new_size > capacity()) {
             change_capacity(new_size);
         }
-        while (size() < new_size) {
-            _size++;
-            new(static_cast<void*>(item_ptr(size() - 1))) T();
+        difference_type increase = new_size - size();
+        if (increase > 0) {
+            _size += increase;
+            fill(item_ptr(new_size - increase), increase);
         }
     }
 
@@ -344,9 +364,7 @@ public:
         }
         memmove(item_ptr(p + count), item_ptr(p), (size() - p) * sizeof(T));
         _size += count;
-        for (size_type i = 0; i < count; i++) {
-            new(static_cast<void*>(item_ptr(p + i))) T(value);
-        }
+        fill(item_ptr(p), count, value);
     }
 
     template<typename InputIterator>
@@ -359,11 +377,7 @@ public:
         }
         memmove(item_ptr(p + count), item_ptr(p), (size() - p) * sizeof(T));
         _size += count;
-        while (first != last) {
-            new(static_cast<void*>(item_ptr(p))) T(*first);
-            ++p;
-            ++first;
-        }
+        fill_from(item_ptr(p), first, last);
     }
 
     iterator erase(iterator pos) {
@@ -373,10 +387,14 @@ public:
     iterator erase(iterator first, iterator last) {
         iterator p = first;
         char* endp = (char*)&(*end());
-        while (p != last) {
-            (*p).~T();
-            _size--;
-            ++p;
+        if (!std::is_trivially_destructible<T>::value) {
+            while (p != last) {
+                (*p).~T();
+                _size--;
+                ++p;
+            }
+        } else {
+            _size -= last - p;
         }
         memmove(&(*first), &(*last), endp - ((char*)(&(*last))));
         return first;
@@ -478,4 +496,10 @@ public:
 };
 #pragma pack(pop)
 
+/** Swap without copying the elements, like std::vector's swap. */
+template<unsigned int N, typename T, typename Size, typename Diff>
+inline void swap(prevector<N, T, Size, Diff>& a, prevector<N, T, Size, Diff>& b) {
+    a.swap(b);
+}
+
 #endif
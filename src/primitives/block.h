@@ -33,7 +33,7 @@ public:
         SetNull();
     }
 
-    ADD_SERIALIZE_METHODS;
+    ADD_SERIALIZE_STREAM_METHODS;
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
@@ -46,6 +46,10 @@ public:
         READWRITE(nNonce);
     }
 
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return sizeof(this->nVersion) + sizeof(hashPrevBlock) + sizeof(hashMerkleRoot) + sizeof(nTime) + sizeof(nBits) + sizeof(nNonce);
+    }
+
     void SetNull()
     {
         nVersion = 0;
@@ -74,7 +78,7 @@ class CBlock : public CBlockHeader
 {
 public:
     // network and disk
-    std::vector<CTransaction> vtx;
+    std::vector<CTransactionRef> vtx;
 
     // memory only
     mutable bool fChecked;
@@ -90,7 +94,7 @@ public:
         *((CBlockHeader*)this) = header;
     }
 
-    ADD_SERIALIZE_METHODS;
+    ADD_SERIALIZE_STREAM_METHODS;
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
@@ -98,6 +102,11 @@ public:
         READWRITE(vtx);
     }
 
+    /** Sums the cached sizes of the transactions, without serializing anything. */
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return CBlockHeader::GetSerializeSize(nType, nVersion) + ::GetSerializeSize(vtx, nType, nVersion);
+    }
+
     void SetNull()
     {
         CBlockHeader::SetNull();
@@ -11,6 +11,8 @@
 #include "serialize.h"
 #include "uint256.h"
 
+#include <memory>
+
 /** An outpoint - a combination of a transaction hash and an index n into its vout */
 class COutPoint
 {
@@ -21,7 +23,7 @@ public:
     COutPoint() { SetNull(); }
     COutPoint(uint256 hashIn, uint32_t nIn) { hash = hashIn; n = nIn; }
 
-    ADD_SERIALIZE_METHODS;
+    ADD_SERIALIZE_STREAM_METHODS;
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
@@ -29,6 +31,10 @@ public:
         READWRITE(n);
     }
 
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return sizeof(hash) + sizeof(n);
+    }
+
     void SetNull() { hash.SetNull(); n = (uint32_t) -1; }
     bool IsNull() const { return (hash.IsNull() && n == (uint32_t) -1); }
 
@@ -97,7 +103,7 @@ public:
     explicit CTxIn(COutPoint prevoutIn, CScript scriptSigIn=CScript(), uint32_t nSequenceIn=SEQUENCE_FINAL);
     CTxIn(uint256 hashPrevTx, uint32_t nOut, CScript scriptSigIn=CScript(), uint32_t nSequenceIn=SEQUENCE_FINAL);
 
-    ADD_SERIALIZE_METHODS;
+    ADD_SERIALIZE_STREAM_METHODS;
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
@@ -106,6 +112,10 @@ public:
         READWRITE(nSequence);
     }
 
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return prevout.GetSerializeSize(nType, nVersion) + scriptSig.GetSerializeSize(nType, nVersion) + sizeof(nSequence);
+    }
+
     friend bool operator==(const CTxIn& a, const CTxIn& b)
     {
         return (a.prevout   == b.prevout &&
@@ -137,7 +147,7 @@ public:
 
     CTxOut(const CAmount& nValueIn, CScript scriptPubKeyIn);
 
-    ADD_SERIALIZE_METHODS;
+    ADD_SERIALIZE_STREAM_METHODS;
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
@@ -145,6 +155,10 @@ public:
         READWRITE(*(CScriptBase*)(&scriptPubKey));
     }
 
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return sizeof(nValue) + scriptPubKey.GetSerializeSize(nType, nVersion);
+    }
+
     void SetNull()
     {
         nValue = -1;
@@ -204,6 +218,8 @@ class CTransaction
 private:
     /** Memory only. */
     const uint256 hash;
+    const unsigned int nSerializeSize;
+    /** Recompute the hash and the serialized size from the fields. */
     void UpdateHash() const;
 
 public:
@@ -220,7 +236,7 @@ public:
     // without updating the cached hash value. However, CTransaction is not
     // actually immutable; deserialization and assignment are implemented,
     // and bypass the constness. This is safe, as they update the entire
-    // structure, including the hash.
+    // structure, including the hash and the serialized size.
     const int32_t nVersion;
     const std::vector<CTxIn> vin;
     const std::vector<CTxOut> vout;
@@ -234,7 +250,7 @@ public:
 
     CTransaction& operator=(const CTransaction& tx);
 
-    ADD_SERIALIZE_METHODS;
+    ADD_SERIALIZE_STREAM_METHODS;
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
@@ -255,6 +271,11 @@ public:
         return hash;
     }
 
+    /** The serialized size, cached along with the hash (it doesn't depend on nType or nVersion). */
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return nSerializeSize;
+    }
+
     // Return sum of txouts.
     CAmount GetValueOut() const;
     // GetValueIn() is a method on CCoinsViewCache, because
@@ -295,7 +316,7 @@ struct CMutableTransaction
     CMutableTransaction();
     CMutableTransaction(const CTransaction& tx);
 
-    ADD_SERIALIZE_METHODS;
+    ADD_SERIALIZE_STREAM_METHODS;
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
@@ -306,10 +327,21 @@ struct CMutableTransaction
         READWRITE(nLockTime);
     }
 
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return sizeof(this->nVersion) + ::GetSerializeSize(vin, nType, nVersion) + ::GetSerializeSize(vout, nType, nVersion) + sizeof(nLockTime);
+    }
+
     /** Compute the hash of this CMutableTransaction. This is computed on the
      * fly, as opposed to GetHash() in CTransaction, which uses a cached result.
      */
     uint256 GetHash() const;
 };
 
+/** A shared, immutable transaction. Blocks, the mempool and relay hold these
+ * instead of copies, so a transaction is deserialized and hashed only once.
+ */
+typedef std::shared_ptr<const CTransaction> CTransactionRef;
+static inline CTransactionRef MakeTransactionRef() { return std::make_shared<const CTransaction>(); }
+template <typename Tx> static inline CTransactionRef MakeTransactionRef(Tx&& txIn) { return std::make_shared<const CTransaction>(std::forward<Tx>(txIn)); }
+
 #endif // BITCOIN_PRIMITIVES_TRANSACTION_H
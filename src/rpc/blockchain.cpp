@@ -3,7 +3,9 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "addrindex.h"
 #include "amount.h"
+#include "base58.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -16,6 +18,9 @@
 #include "streams.h"
 #include "sync.h"
 #include "txmempool.h"
+#include "txdb.h"
+#include "txindex.h"
+#include "txmempooloverflow.h"
 #include "util.h"
 #include "utilstrencodings.h"
 #include "hash.h"
@@ -105,8 +110,9 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     result.push_back(Pair("versionHex", strprintf("%08x", block.nVersion)));
     result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
     UniValue txs(UniValue::VARR);
-    BOOST_FOREACH(const CTransaction&tx, block.vtx)
+    BOOST_FOREACH(const CTransactionRef& ptx, block.vtx)
     {
+        const CTransaction& tx = *ptx;
         if(txDetails)
         {
             UniValue objTx(UniValue::VOBJ);
@@ -280,6 +286,70 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
     return mempoolToJSON(fVerbose);
 }
 
+UniValue getmempoolchanges(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getmempoolchanges sequence\n"
+            "\nReturns the transactions added to and removed from the memory pool since the given mempool sequence number.\n"
+            "Every addition and removal increments the sequence number. Only a limited number of recent changes is kept;\n"
+            "if some of the requested ones are no longer available, the full list of transaction ids is returned instead.\n"
+            "\nArguments:\n"
+            "1. sequence          (numeric, required) The sequence number returned by the previous call, or 0\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"sequence\" : n,         (numeric) The current mempool sequence number, to pass to the next call\n"
+            "  \"resync\" : true|false,  (boolean) Whether the changes could not be provided and \"txids\" is returned instead\n"
+            "  \"changes\" : [           (array) The changes, oldest first, if resync is false\n"
+            "    {\n"
+            "      \"sequence\" : n,     (numeric) The sequence number of this change\n"
+            "      \"txid\" : \"hash\",   (string) The transaction id\n"
+            "      \"type\" : \"type\",   (string) \"added\" or \"removed\"\n"
+            "      \"reason\" : \"reason\" (string, removals only) Why it was removed: \"expiry\", \"sizelimit\", \"reorg\", \"block\", \"conflict\", \"replaced\" or \"unknown\"\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"txids\" : [             (array) All transaction ids in the mempool, if resync is true\n"
+            "    \"transactionid\", ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples\n"
+            + HelpExampleCli("getmempoolchanges", "0")
+            + HelpExampleRpc("getmempoolchanges", "0")
+        );
+
+    int64_t nSince = params[0].get_int64();
+    if (nSince < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative sequence number");
+
+    LOCK(mempool.cs);
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("sequence", (int64_t) mempool.GetSequence()));
+    std::vector<CTxMemPoolChange> vChanges;
+    if (mempool.GetChangesSince(nSince, vChanges)) {
+        UniValue changes(UniValue::VARR);
+        BOOST_FOREACH(const CTxMemPoolChange& change, vChanges) {
+            UniValue o(UniValue::VOBJ);
+            o.push_back(Pair("sequence", (int64_t) change.nSequence));
+            o.push_back(Pair("txid", change.txid.GetHex()));
+            o.push_back(Pair("type", change.fAdded ? "added" : "removed"));
+            if (!change.fAdded)
+                o.push_back(Pair("reason", RemovalReasonToString(change.reason)));
+            changes.push_back(o);
+        }
+        ret.push_back(Pair("resync", false));
+        ret.push_back(Pair("changes", changes));
+    } else {
+        std::vector<uint256> vtxid;
+        mempool.queryHashes(vtxid);
+        UniValue txids(UniValue::VARR);
+        BOOST_FOREACH(const uint256& hash, vtxid)
+            txids.push_back(hash.ToString());
+        ret.push_back(Pair("resync", true));
+        ret.push_back(Pair("txids", txids));
+    }
+    return ret;
+}
+
 UniValue getblockhash(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -421,17 +491,17 @@ UniValue getblock(const UniValue& params, bool fHelp)
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
-    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
-
     if (!fVerbose)
     {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+        std::vector<unsigned char> vchBlock;
+        if (!ReadRawBlockFromDisk(vchBlock, pblockindex, Params().MessageStart()))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+        return HexStr(vchBlock.begin(), vchBlock.end());
     }
 
+    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+
     return blockToJSON(block, pblockindex);
 }
 
@@ -527,6 +597,80 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
     return ret;
 }
 
+static UniValue DBStatsToJSON(const CDBWrapper& db)
+{
+    CDBStats stats;
+    db.GetStats(stats);
+    const CDBTuning& tuning = db.GetTuning();
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("blockcache", (uint64_t)tuning.nBlockCache));
+    ret.push_back(Pair("writebuffer", (uint64_t)tuning.nWriteBuffer));
+    ret.push_back(Pair("bloombits", tuning.nBloomBits));
+    ret.push_back(Pair("approximatesize", stats.nApproximateSize));
+    UniValue levels(UniValue::VARR);
+    BOOST_FOREACH(const CDBLevelStats& level, stats.vLevels) {
+        UniValue o(UniValue::VOBJ);
+        o.push_back(Pair("level", level.nLevel));
+        o.push_back(Pair("files", level.nFiles));
+        o.push_back(Pair("size", level.dSize));
+        o.push_back(Pair("compactiontime", level.dCompactionTime));
+        o.push_back(Pair("compactionread", level.dCompactionRead));
+        o.push_back(Pair("compactionwrite", level.dCompactionWrite));
+        levels.push_back(o);
+    }
+    ret.push_back(Pair("levels", levels));
+    ret.push_back(Pair("stats", stats.strStats));
+    return ret;
+}
+
+UniValue getdbstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getdbstats\n"
+            "\nReturns the settings and LevelDB statistics of the chain state and block index databases.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"chainstate\": {           (object) The chain state database\n"
+            "    \"blockcache\": n,        (numeric) Size of the LevelDB block cache in bytes\n"
+            "    \"writebuffer\": n,       (numeric) Size of the LevelDB write buffer in bytes\n"
+            "    \"bloombits\": n,         (numeric) Bloom filter bits per key, 0 if none\n"
+            "    \"approximatesize\": n,   (numeric) Approximate size on disk in bytes\n"
+            "    \"levels\": [             (array) The non-empty levels\n"
+            "      {\n"
+            "        \"level\": n,         (numeric) The level\n"
+            "        \"files\": n,         (numeric) Number of table files\n"
+            "        \"size\": n,          (numeric) Size in MB\n"
+            "        \"compactiontime\": n,  (numeric) Seconds spent compacting into this level\n"
+            "        \"compactionread\": n,  (numeric) MB read by those compactions\n"
+            "        \"compactionwrite\": n  (numeric) MB written by those compactions\n"
+            "      }, ...\n"
+            "    ],\n"
+            "    \"stats\": \"str\"          (string) LevelDB's own statistics report\n"
+            "  },\n"
+            "  \"blockindex\": { ... }     (object) The block index database, in the same format\n"
+            "  \"txindex\": { ... }        (object) The transaction index database, if enabled, in the same format\n"
+            "  \"addrindex\": { ... }      (object) The address index database, if enabled, in the same format\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "")
+            + HelpExampleRpc("getdbstats", "")
+        );
+
+    LOCK(cs_main);
+    UniValue ret(UniValue::VOBJ);
+    if (pcoinsdbview)
+        ret.push_back(Pair("chainstate", DBStatsToJSON(pcoinsdbview->GetDB())));
+    if (pblocktree)
+        ret.push_back(Pair("blockindex", DBStatsToJSON(*pblocktree)));
+    if (ptxindex)
+        ret.push_back(Pair("txindex", DBStatsToJSON(ptxindex->GetDB())));
+    if (paddrindex)
+        ret.push_back(Pair("addrindex", DBStatsToJSON(paddrindex->GetDB())));
+    return ret;
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -607,6 +751,103 @@ UniValue gettxout(const UniValue& params, bool fHelp)
     return ret;
 }
 
+UniValue getaddressoutputs(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 3)
+        throw runtime_error(
+            "getaddressoutputs \"address\" ( count \"after\" )\n"
+            "\nReturns the outputs to an address in the active chain, spent or not, in the order they were confirmed.\n"
+            "Requires the address index (-addrindex).\n"
+            "\nArguments:\n"
+            "1. \"address\"    (string, required) The bitcoin address\n"
+            "2. count          (numeric, optional, default=100, max=" + strprintf("%u", MAX_ADDRINDEX_QUERY) + ") The number of outputs to return\n"
+            "3. \"after\"      (string, optional) Return the outputs after this one, as given by \"last\" in an earlier result\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"outputs\": [\n"
+            "    {\n"
+            "      \"height\": n,           (numeric) The height of the block that created the output\n"
+            "      \"txid\": \"hash\",        (string) The transaction id\n"
+            "      \"vout\": n,             (numeric) The output number\n"
+            "      \"value\": x.xxx,        (numeric) The value in " + CURRENCY_UNIT + "\n"
+            "      \"spentby\": {           (object) The input that spent the output, if it is spent\n"
+            "        \"txid\": \"hash\",      (string) The spending transaction id\n"
+            "        \"vin\": n,            (numeric) The input number\n"
+            "        \"height\": n          (numeric) The height of the block that spent the output\n"
+            "      }\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"last\": \"xxxx\"           (string) The position of the last output, to pass as \"after\" for the next ones, if any were returned\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressoutputs", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"")
+            + HelpExampleRpc("getaddressoutputs", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\", 10")
+        );
+
+    if (!paddrindex)
+        throw JSONRPCError(RPC_MISC_ERROR, "The address index is not enabled. Use -addrindex to enable it.");
+
+    CBitcoinAddress address(params[0].get_str());
+    if (!address.IsValid())
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid Bitcoin address");
+    CScript scriptPubKey = GetScriptForDestination(address.Get());
+
+    int nCount = 100;
+    if (params.size() > 1)
+        nCount = params[1].get_int();
+    if (nCount < 1 || nCount > (int)MAX_ADDRINDEX_QUERY)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Count out of range");
+
+    CAddrIndexPos posAfter;
+    bool fAfter = params.size() > 2;
+    if (fAfter) {
+        std::string strAfter = params[2].get_str();
+        if (!IsHex(strAfter))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid position");
+        std::vector<unsigned char> data(ParseHex(strAfter));
+        CDataStream ssAfter(data, SER_NETWORK, PROTOCOL_VERSION);
+        try {
+            ssAfter >> posAfter;
+        } catch (const std::exception&) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid position");
+        }
+    }
+
+    // Outputs of blocks that were just connected should be there
+    paddrindex->BlockUntilSyncedToCurrentChain();
+
+    std::vector<std::pair<COutPoint, CAddrIndexEntry> > vOutputs;
+    if (!paddrindex->FindOutputs(scriptPubKey, fAfter ? &posAfter : NULL, nCount, vOutputs))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the address index");
+
+    UniValue outputs(UniValue::VARR);
+    for (std::vector<std::pair<COutPoint, CAddrIndexEntry> >::const_iterator it = vOutputs.begin(); it != vOutputs.end(); it++) {
+        const CAddrIndexEntry& entry = it->second;
+        UniValue output(UniValue::VOBJ);
+        output.push_back(Pair("height", entry.nHeight));
+        output.push_back(Pair("txid", it->first.hash.GetHex()));
+        output.push_back(Pair("vout", (int)it->first.n));
+        output.push_back(Pair("value", ValueFromAmount(entry.nValue)));
+        if (entry.IsSpent()) {
+            UniValue spentby(UniValue::VOBJ);
+            spentby.push_back(Pair("txid", entry.spentBy.hash.GetHex()));
+            spentby.push_back(Pair("vin", (int)entry.spentBy.n));
+            spentby.push_back(Pair("height", entry.nSpentHeight));
+            output.push_back(Pair("spentby", spentby));
+        }
+        outputs.push_back(output);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("outputs", outputs));
+    if (!vOutputs.empty()) {
+        CDataStream ssLast(SER_NETWORK, PROTOCOL_VERSION);
+        ssLast << CAddrIndexPos(vOutputs.back().second.nHeight, vOutputs.back().first);
+        ret.push_back(Pair("last", HexStr(ssLast.begin(), ssLast.end())));
+    }
+    return ret;
+}
+
 UniValue verifychain(const UniValue& params, bool fHelp)
 {
     int nCheckLevel = GetArg("-checklevel", DEFAULT_CHECKLEVEL);
@@ -703,6 +944,11 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
             "  \"pruned\": xx,             (boolean) if the blocks are subject to pruning\n"
             "  \"pruneheight\": xxxxxx,    (numeric) heighest block available\n"
+            "  \"txindex\": {              (object) state of the transaction index, if enabled\n"
+            "     \"blocks\": xxxxxx,        (numeric) height up to which transactions are indexed, -1 if none\n"
+            "     \"synced\": xx             (boolean) whether the index has caught up with the active chain\n"
+            "  },\n"
+            "  \"addrindex\": { ... }      (object) state of the address index, if enabled, in the same format\n"
             "  \"softforks\": [            (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",        (string) name of softfork\n"
@@ -762,6 +1008,23 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
 
         obj.push_back(Pair("pruneheight",        block->nHeight));
     }
+
+    if (ptxindex)
+    {
+        const CBlockIndex *pindexTxIndex = ptxindex->GetBestBlock();
+        UniValue txindex(UniValue::VOBJ);
+        txindex.push_back(Pair("blocks",         pindexTxIndex ? pindexTxIndex->nHeight : -1));
+        txindex.push_back(Pair("synced",         ptxindex->IsSynced()));
+        obj.push_back(Pair("txindex",            txindex));
+    }
+    if (paddrindex)
+    {
+        const CBlockIndex *pindexAddrIndex = paddrindex->GetBestBlock();
+        UniValue addrindex(UniValue::VOBJ);
+        addrindex.push_back(Pair("blocks",       pindexAddrIndex ? pindexAddrIndex->nHeight : -1));
+        addrindex.push_back(Pair("synced",       paddrindex->IsSynced()));
+        obj.push_back(Pair("addrindex",          addrindex));
+    }
     return obj;
 }
 
@@ -826,7 +1089,7 @@ UniValue getchaintips(const UniValue& params, bool fHelp)
     std::set<const CBlockIndex*> setOrphans;
     std::set<const CBlockIndex*> setPrevs;
 
-    BOOST_FOREACH(const PAIRTYPE(const uint256, CBlockIndex*)& item, mapBlockIndex)
+    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
     {
         if (!chainActive.Contains(item.second)) {
             setOrphans.insert(item.second);
@@ -892,6 +1155,8 @@ UniValue mempoolInfoToJSON()
     size_t maxmempool = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     ret.push_back(Pair("maxmempool", (int64_t) maxmempool));
     ret.push_back(Pair("mempoolminfee", ValueFromAmount(mempool.GetMinFee(maxmempool).GetFeePerK())));
+    ret.push_back(Pair("overflowsize", (int64_t) mempoolOverflow.size()));
+    ret.push_back(Pair("overflowbytes", (int64_t) mempoolOverflow.GetDiskUsage()));
 
     return ret;
 }
@@ -908,7 +1173,9 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
             "  \"bytes\": xxxxx,              (numeric) Sum of all tx sizes\n"
             "  \"usage\": xxxxx,              (numeric) Total memory usage for the mempool\n"
             "  \"maxmempool\": xxxxx,         (numeric) Maximum memory usage for the mempool\n"
-            "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee for tx to be accepted\n"
+            "  \"mempoolminfee\": xxxxx,      (numeric) Minimum fee for tx to be accepted\n"
+            "  \"overflowsize\": xxxxx,       (numeric) Number of evicted txs kept on disk to be re-added later\n"
+            "  \"overflowbytes\": xxxxx       (numeric) Size of the file holding them\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmempoolinfo", "")
@@ -996,6 +1263,7 @@ UniValue reconsiderblock(const UniValue& params, bool fHelp)
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafeMode
   //  --------------------- ------------------------  -----------------------  ----------
+    { "blockchain",         "getaddressoutputs",      &getaddressoutputs,      true  },
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true  },
     { "blockchain",         "getbestblockhash",       &getbestblockhash,       true  },
     { "blockchain",         "getblockcount",          &getblockcount,          true  },
@@ -1003,7 +1271,9 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockhash",           &getblockhash,           true  },
     { "blockchain",         "getblockheader",         &getblockheader,         true  },
     { "blockchain",         "getchaintips",           &getchaintips,           true  },
+    { "blockchain",         "getdbstats",             &getdbstats,             true  },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
+    { "blockchain",         "getmempoolchanges",      &getmempoolchanges,      true  },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
     { "blockchain",         "gettxout",               &gettxout,               true  },
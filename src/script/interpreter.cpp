@@ -15,7 +15,7 @@
 
 using namespace std;
 
-typedef vector<unsigned char> valtype;
+typedef CScriptStackValue valtype;
 
 namespace {
 
@@ -56,13 +56,19 @@ bool CastToBool(const valtype& vch)
  */
 #define stacktop(i)  (stack.at(stack.size()+(i)))
 #define altstacktop(i)  (altstack.at(altstack.size()+(i)))
-static inline void popstack(vector<valtype>& stack)
+static inline void popstack(CScriptStack& stack)
 {
     if (stack.empty())
         throw runtime_error("popstack(): stack empty");
     stack.pop_back();
 }
 
+static inline void pushnum(CScriptStack& stack, const CScriptNum& bn)
+{
+    stack.push_back(valtype());
+    bn.getvch(stack.back());
+}
+
 bool static IsCompressedOrUncompressedPubKey(const valtype &vchPubKey) {
     if (vchPubKey.size() < 33) {
         //  Non-canonical public key: too short
@@ -95,7 +101,7 @@ bool static IsCompressedOrUncompressedPubKey(const valtype &vchPubKey) {
  *
  * This function is consensus-critical since BIP66.
  */
-bool static IsValidSignatureEncoding(const std::vector<unsigned char> &sig) {
+bool static IsValidSignatureEncoding(const valtype &sig) {
     // Format: 0x30 [total-length] 0x02 [R-length] [R] 0x02 [S-length] [S] [sighash]
     // * total-length: 1-byte length descriptor of everything that follows,
     //   excluding the sighash byte.
@@ -182,7 +188,7 @@ bool static IsDefinedHashtypeSignature(const valtype &vchSig) {
     return true;
 }
 
-bool CheckSignatureEncoding(const vector<unsigned char> &vchSig, unsigned int flags, ScriptError* serror) {
+bool CheckSignatureEncoding(const valtype &vchSig, unsigned int flags, ScriptError* serror) {
     // Empty signature. Not strictly DER encoded, but allowed to provide a
     // compact way to provide an invalid signature for use with CHECK(MULTI)SIG
     if (vchSig.size() == 0) {
@@ -229,7 +235,7 @@ bool static CheckMinimalPush(const valtype& data, opcodetype opcode) {
     return true;
 }
 
-bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+bool EvalScript(CScriptStack& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
 {
     static const CScriptNum bnZero(0);
     static const CScriptNum bnOne(1);
@@ -237,7 +243,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
     static const CScriptNum bnTrue(1);
     static const valtype vchFalse(0);
     static const valtype vchZero(0);
-    static const valtype vchTrue(1, 1);
+    static const valtype vchTrue(1, (unsigned char)1);
 
     CScript::const_iterator pc = script.begin();
     CScript::const_iterator pend = script.end();
@@ -245,7 +251,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
     opcodetype opcode;
     valtype vchPushValue;
     vector<bool> vfExec;
-    vector<valtype> altstack;
+    CScriptStack altstack;
     set_error(serror, SCRIPT_ERR_UNKNOWN_ERROR);
     if (script.size() > MAX_SCRIPT_SIZE)
         return set_error(serror, SCRIPT_ERR_SCRIPT_SIZE);
@@ -318,7 +324,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                 {
                     // ( -- value)
                     CScriptNum bn((int)opcode - (int)(OP_1 - 1));
-                    stack.push_back(bn.getvch());
+                    pushnum(stack, bn);
                     // The result of these opcodes should always be the minimal way to push the data
                     // they push, so no need for a CheckMinimalPush here.
                 }
@@ -581,7 +587,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                 {
                     // -- stacksize
                     CScriptNum bn(stack.size());
-                    stack.push_back(bn.getvch());
+                    pushnum(stack, bn);
                 }
                 break;
 
@@ -679,7 +685,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     CScriptNum bn(stacktop(-1).size());
-                    stack.push_back(bn.getvch());
+                    pushnum(stack, bn);
                 }
                 break;
 
@@ -741,7 +747,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     default:            assert(!"invalid opcode"); break;
                     }
                     popstack(stack);
-                    stack.push_back(bn.getvch());
+                    pushnum(stack, bn);
                 }
                 break;
 
@@ -790,7 +796,7 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
                     }
                     popstack(stack);
                     popstack(stack);
-                    stack.push_back(bn.getvch());
+                    pushnum(stack, bn);
 
                     if (opcode == OP_NUMEQUALVERIFY)
                     {
@@ -1007,8 +1013,68 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
     return set_success(serror);
 }
 
+bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    CScriptStack stackEval;
+    stackEval.reserve(stack.size());
+    for (size_t i = 0; i < stack.size(); i++)
+        stackEval.push_back(valtype(stack[i].begin(), stack[i].end()));
+    bool fSuccess = EvalScript(stackEval, script, flags, checker, serror);
+    stack.resize(stackEval.size());
+    for (size_t i = 0; i < stack.size(); i++)
+        stack[i].assign(stackEval[i].begin(), stackEval[i].end());
+    return fSuccess;
+}
+
 namespace {
 
+/** Serialize a scriptCode, skipping OP_CODESEPARATORs */
+template<typename S>
+void SerializeScriptCode(S &s, const CScript &scriptCode) {
+    CScript::const_iterator it = scriptCode.begin();
+    CScript::const_iterator itBegin = it;
+    opcodetype opcode;
+    unsigned int nCodeSeparators = 0;
+    while (scriptCode.GetOp(it, opcode)) {
+        if (opcode == OP_CODESEPARATOR)
+            nCodeSeparators++;
+    }
+    ::WriteCompactSize(s, scriptCode.size() - nCodeSeparators);
+    it = itBegin;
+    while (scriptCode.GetOp(it, opcode)) {
+        if (opcode == OP_CODESEPARATOR) {
+            s.write((char*)&itBegin[0], it-itBegin-1);
+            itBegin = it;
+        }
+    }
+    if (itBegin != scriptCode.end())
+        s.write((char*)&itBegin[0], it-itBegin);
+}
+
+/** Stream that appends to a byte vector */
+class CByteVectorWriter
+{
+private:
+    std::vector<unsigned char>& vch;
+
+public:
+    int nType;
+    int nVersion;
+
+    CByteVectorWriter(std::vector<unsigned char>& vchIn, int nTypeIn, int nVersionIn) : vch(vchIn), nType(nTypeIn), nVersion(nVersionIn) {}
+
+    CByteVectorWriter& write(const char *pch, size_t size) {
+        vch.insert(vch.end(), (const unsigned char*)pch, (const unsigned char*)pch + size);
+        return (*this);
+    }
+
+    template<typename T>
+    CByteVectorWriter& operator<<(const T& obj) {
+        ::Serialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
 /**
  * Wrapper that serializes like CTransaction, but with the modifications
  *  required for the signature hash done in-place
@@ -1029,29 +1095,6 @@ public:
         fHashSingle((nHashTypeIn & 0x1f) == SIGHASH_SINGLE),
         fHashNone((nHashTypeIn & 0x1f) == SIGHASH_NONE) {}
 
-    /** Serialize the passed scriptCode, skipping OP_CODESEPARATORs */
-    template<typename S>
-    void SerializeScriptCode(S &s, int nType, int nVersion) const {
-        CScript::const_iterator it = scriptCode.begin();
-        CScript::const_iterator itBegin = it;
-        opcodetype opcode;
-        unsigned int nCodeSeparators = 0;
-        while (scriptCode.GetOp(it, opcode)) {
-            if (opcode == OP_CODESEPARATOR)
-                nCodeSeparators++;
-        }
-        ::WriteCompactSize(s, scriptCode.size() - nCodeSeparators);
-        it = itBegin;
-        while (scriptCode.GetOp(it, opcode)) {
-            if (opcode == OP_CODESEPARATOR) {
-                s.write((char*)&itBegin[0], it-itBegin-1);
-                itBegin = it;
-            }
-        }
-        if (itBegin != scriptCode.end())
-            s.write((char*)&itBegin[0], it-itBegin);
-    }
-
     /** Serialize an input of txTo */
     template<typename S>
     void SerializeInput(S &s, unsigned int nInput, int nType, int nVersion) const {
@@ -1065,7 +1108,7 @@ public:
             // Blank out other inputs' signatures
             ::Serialize(s, CScriptBase(), nType, nVersion);
         else
-            SerializeScriptCode(s, nType, nVersion);
+            SerializeScriptCode(s, scriptCode);
         // Serialize the nSequence
         if (nInput != nIn && (fHashSingle || fHashNone))
             // let the others update at will
@@ -1106,7 +1149,28 @@ public:
 
 } // anon namespace
 
-uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
+PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo)
+{
+    // Everything up to the first input: nVersion and the number of inputs
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << txTo.nVersion;
+    ::WriteCompactSize(ss, txTo.vin.size());
+
+    CByteVectorWriter inputs(vchInputs, SER_GETHASH, 0);
+    vchInputs.reserve(txTo.vin.size() * BLANKED_INPUT_SIZE);
+    vPrefix.reserve(txTo.vin.size());
+    for (unsigned int nInput = 0; nInput < txTo.vin.size(); nInput++) {
+        vPrefix.push_back(ss);
+        size_t nPos = vchInputs.size();
+        inputs << txTo.vin[nInput].prevout << CScriptBase() << txTo.vin[nInput].nSequence;
+        ss.write((const char*)&vchInputs[nPos], BLANKED_INPUT_SIZE);
+    }
+
+    CByteVectorWriter tail(vchTail, SER_GETHASH, 0);
+    tail << txTo.vout << txTo.nLockTime;
+}
+
+uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* cache)
 {
     static const uint256 one(uint256S("0000000000000000000000000000000000000000000000000000000000000001"));
     if (nIn >= txTo.vin.size()) {
@@ -1122,6 +1186,20 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
         }
     }
 
+    // With SIGHASH_ALL, the same as below, but picking up where the inputs
+    // before nIn left off.
+    if (cache && !(nHashType & SIGHASH_ANYONECANPAY) && (nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE) {
+        CHashWriter ss(cache->vPrefix[nIn]);
+        ss << txTo.vin[nIn].prevout;
+        SerializeScriptCode(ss, scriptCode);
+        ss << txTo.vin[nIn].nSequence;
+        size_t nAfter = (nIn + 1) * PrecomputedTransactionData::BLANKED_INPUT_SIZE;
+        ss.write((const char*)begin_ptr(cache->vchInputs) + nAfter, cache->vchInputs.size() - nAfter);
+        ss.write((const char*)begin_ptr(cache->vchTail), cache->vchTail.size());
+        ss << nHashType;
+        return ss.GetHash();
+    }
+
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
@@ -1136,20 +1214,19 @@ bool TransactionSignatureChecker::VerifySignature(const std::vector<unsigned cha
     return pubkey.Verify(sighash, vchSig);
 }
 
-bool TransactionSignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn, const vector<unsigned char>& vchPubKey, const CScript& scriptCode) const
+bool TransactionSignatureChecker::CheckSig(const valtype& vchSigIn, const valtype& vchPubKey, const CScript& scriptCode) const
 {
-    CPubKey pubkey(vchPubKey);
+    CPubKey pubkey(vchPubKey.begin(), vchPubKey.end());
     if (!pubkey.IsValid())
         return false;
 
     // Hash type is one byte tacked on to the end of the signature
-    vector<unsigned char> vchSig(vchSigIn);
-    if (vchSig.empty())
+    if (vchSigIn.empty())
         return false;
-    int nHashType = vchSig.back();
-    vchSig.pop_back();
+    int nHashType = vchSigIn.back();
+    vector<unsigned char> vchSig(vchSigIn.begin(), vchSigIn.end() - 1);
 
-    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType);
+    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType, txdata);
 
     if (!VerifySignature(vchSig, pubkey, sighash))
         return false;
@@ -1239,15 +1316,229 @@ bool TransactionSignatureChecker::CheckSequence(const CScriptNum& nSequence) con
     return true;
 }
 
+namespace {
+
+/** A data push of a script, referring to the script's bytes. */
+struct ScriptPush
+{
+    const unsigned char* data;
+    size_t size;
+};
+
+/** Most pushes a scriptSig handled by VerifyStandardScript has: 16 signatures, the dummy and a redeem script. */
+const int MAX_STANDARD_PUSHES = 18;
+
+/**
+ * Split a script made of data pushes into its pushes, as EvalScript would
+ * push them. Only minimally encoded pushes (see CheckMinimalPush) that fit
+ * MAX_SCRIPT_ELEMENT_SIZE are accepted, so the result doesn't depend on the
+ * flags. Returns false for any other script.
+ */
+bool GetScriptPushes(const CScript& script, ScriptPush* pushes, int& nPushes)
+{
+    nPushes = 0;
+    const unsigned char* pc = begin_ptr(script);
+    const unsigned char* pend = end_ptr(script);
+    while (pc < pend) {
+        unsigned int opcode = *pc++;
+        size_t nSize;
+        if (opcode < OP_PUSHDATA1) {
+            nSize = opcode;
+        } else if (opcode == OP_PUSHDATA1) {
+            if (pend - pc < 1)
+                return false;
+            nSize = pc[0];
+            pc += 1;
+            if (nSize < OP_PUSHDATA1)
+                return false;
+        } else if (opcode == OP_PUSHDATA2) {
+            if (pend - pc < 2)
+                return false;
+            nSize = ReadLE16(pc);
+            pc += 2;
+            if (nSize <= 0xff)
+                return false;
+        } else {
+            return false;
+        }
+        if ((size_t)(pend - pc) < nSize || nSize > MAX_SCRIPT_ELEMENT_SIZE || nPushes == MAX_STANDARD_PUSHES)
+            return false;
+        // Those have their own opcodes
+        if (nSize == 1 && ((pc[0] >= 1 && pc[0] <= 16) || pc[0] == 0x81))
+            return false;
+        pushes[nPushes].data = pc;
+        pushes[nPushes].size = nSize;
+        nPushes++;
+        pc += nSize;
+    }
+    return true;
+}
+
+bool operator==(const ScriptPush& a, const ScriptPush& b)
+{
+    return a.size == b.size && memcmp(a.data, b.data, a.size) == 0;
+}
+
+/**
+ * The checks of OP_CHECKSIG and OP_CHECKMULTISIG for one signature. Sets
+ * fOk to the result of the signature check, and returns false if the
+ * encoding is invalid, which fails the script.
+ */
+bool CheckStandardSig(const ScriptPush& sig, const ScriptPush& pubkey, const CScript& scriptCode, unsigned int flags, const BaseSignatureChecker& checker, bool& fOk)
+{
+    valtype vchSig(sig.data, sig.data + sig.size);
+    valtype vchPubKey(pubkey.data, pubkey.data + pubkey.size);
+    if (!CheckSignatureEncoding(vchSig, flags, NULL) || !CheckPubKeyEncoding(vchPubKey, flags, NULL))
+        return false;
+    fOk = checker.CheckSig(vchSig, vchPubKey, scriptCode);
+    return true;
+}
+
+/** Match a push of a 33 or 65 byte public key at pc. */
+bool GetPubKeyPush(const CScript& script, const unsigned char*& pc, ScriptPush& pubkey)
+{
+    const unsigned char* pend = end_ptr(script);
+    if (pc == pend || (*pc != 33 && *pc != 65) || pend - pc < 1 + *pc)
+        return false;
+    pubkey.size = *pc;
+    pubkey.data = pc + 1;
+    pc += 1 + pubkey.size;
+    return true;
+}
+
+/**
+ * Run a pay-to-pubkey-hash, pay-to-pubkey or bare multisig script on a stack
+ * of nStack pushes, like EvalScript. On success, it consumed its arguments and
+ * pushed true, and nStack is updated. Returns false for other scripts, and
+ * when the script fails.
+ *
+ * The signatures are deleted from the script code (FindAndDelete) before they
+ * are checked. In these scripts, a signature can only match a whole push,
+ * so it would change the script code only if it were equal to a public key or
+ * hash in it; we leave that case to EvalScript.
+ */
+bool EvalStandardScript(const CScript& script, const ScriptPush* stack, int& nStack, unsigned int flags, const BaseSignatureChecker& checker)
+{
+    const unsigned char* pc = begin_ptr(script);
+    const unsigned char* pend = end_ptr(script);
+    ScriptPush pubkey;
+    bool fOk = false;
+
+    // OP_DUP OP_HASH160 <hash> OP_EQUALVERIFY OP_CHECKSIG
+    if (script.size() == 25 && pc[0] == OP_DUP && pc[1] == OP_HASH160 && pc[2] == 20 &&
+        pc[23] == OP_EQUALVERIFY && pc[24] == OP_CHECKSIG) {
+        if (nStack < 2)
+            return false;
+        const ScriptPush& sig = stack[nStack - 2];
+        pubkey = stack[nStack - 1];
+        unsigned char hash[20];
+        CHash160().Write(pubkey.data, pubkey.size).Finalize(hash);
+        ScriptPush hashPush = {pc + 3, 20};
+        if (memcmp(hash, hashPush.data, 20) != 0 || sig == hashPush)
+            return false;
+        if (!CheckStandardSig(sig, pubkey, script, flags, checker, fOk) || !fOk)
+            return false;
+        nStack -= 1;
+        return true;
+    }
+
+    // <pubkey> OP_CHECKSIG
+    if (GetPubKeyPush(script, pc, pubkey) && pend - pc == 1 && pc[0] == OP_CHECKSIG) {
+        if (nStack < 1)
+            return false;
+        const ScriptPush& sig = stack[nStack - 1];
+        if (sig == pubkey)
+            return false;
+        return CheckStandardSig(sig, pubkey, script, flags, checker, fOk) && fOk;
+    }
+
+    // OP_m <pubkey>... OP_n OP_CHECKMULTISIG
+    pc = begin_ptr(script);
+    if (script.size() < 3 || pc[0] < OP_1 || pc[0] > OP_16)
+        return false;
+    const int nSigsRequired = pc[0] - (OP_1 - 1);
+    int nSigsCount = nSigsRequired;
+    pc++;
+    ScriptPush pubkeys[16];
+    int nKeysCount = 0;
+    while (nKeysCount < 16 && GetPubKeyPush(script, pc, pubkeys[nKeysCount]))
+        nKeysCount++;
+    if (pend - pc != 2 || pc[0] != OP_1 + nKeysCount - 1 || pc[1] != OP_CHECKMULTISIG || nKeysCount < nSigsCount)
+        return false;
+    // The signatures, and the dummy argument
+    if (nStack < nSigsCount + 1)
+        return false;
+    for (int i = 0; i < nSigsCount; i++) {
+        for (int k = 0; k < nKeysCount; k++) {
+            if (stack[nStack - 1 - i] == pubkeys[k])
+                return false;
+        }
+    }
+    if ((flags & SCRIPT_VERIFY_NULLDUMMY) && stack[nStack - 1 - nSigsCount].size != 0)
+        return false;
+    // Both from the last one, as in EvalScript
+    int isig = nStack - 1, ikey = nKeysCount - 1;
+    while (nSigsCount > 0) {
+        if (!CheckStandardSig(stack[isig], pubkeys[ikey], script, flags, checker, fOk))
+            return false;
+        if (fOk) {
+            isig--;
+            nSigsCount--;
+        }
+        ikey--;
+        nKeysCount--;
+        if (nSigsCount > nKeysCount)
+            return false;
+    }
+    nStack -= nSigsRequired;
+    return true;
+}
+
+} // anon namespace
+
+bool VerifyStandardScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker)
+{
+    ScriptPush stack[MAX_STANDARD_PUSHES];
+    int nStack;
+    if (scriptSig.size() > MAX_SCRIPT_SIZE || !GetScriptPushes(scriptSig, stack, nStack))
+        return false;
+
+    if (scriptPubKey.IsPayToScriptHash()) {
+        // OP_HASH160 <hash> OP_EQUAL
+        if (nStack == 0)
+            return false;
+        const ScriptPush& redeemScript = stack[nStack - 1];
+        unsigned char hash[20];
+        CHash160().Write(redeemScript.data, redeemScript.size).Finalize(hash);
+        if (memcmp(hash, begin_ptr(scriptPubKey) + 2, 20) != 0)
+            return false;
+        if (!(flags & SCRIPT_VERIFY_P2SH))
+            return !(flags & SCRIPT_VERIFY_CLEANSTACK);
+        nStack--;
+        if (!EvalStandardScript(CScript(redeemScript.data, redeemScript.data + redeemScript.size), stack, nStack, flags, checker))
+            return false;
+    } else if (!EvalStandardScript(scriptPubKey, stack, nStack, flags, checker)) {
+        return false;
+    }
+
+    if ((flags & SCRIPT_VERIFY_CLEANSTACK) && nStack != 1)
+        return false;
+    return true;
+}
+
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
 {
     set_error(serror, SCRIPT_ERR_UNKNOWN_ERROR);
 
+    // Most scripts are standard and valid, and don't need the interpreter.
+    if (VerifyStandardScript(scriptSig, scriptPubKey, flags, checker))
+        return set_success(serror);
+
     if ((flags & SCRIPT_VERIFY_SIGPUSHONLY) != 0 && !scriptSig.IsPushOnly()) {
         return set_error(serror, SCRIPT_ERR_SIG_PUSHONLY);
     }
 
-    vector<vector<unsigned char> > stack, stackCopy;
+    CScriptStack stack, stackCopy;
     if (!EvalScript(stack, scriptSig, flags, checker, serror))
         // serror is set
         return false;
@@ -1269,7 +1560,7 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigne
             return set_error(serror, SCRIPT_ERR_SIG_PUSHONLY);
 
         // Restore stack.
-        swap(stack, stackCopy);
+        stack.swap(stackCopy);
 
         // stack cannot be empty here, because if it was the
         // P2SH  HASH <> EQUAL  scriptPubKey would be evaluated with
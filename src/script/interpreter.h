@@ -6,6 +6,7 @@
 #ifndef BITCOIN_SCRIPT_INTERPRETER_H
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
+#include "hash.h"
 #include "script_error.h"
 #include "primitives/transaction.h"
 
@@ -88,14 +89,42 @@ enum
     SCRIPT_VERIFY_CHECKSEQUENCEVERIFY = (1U << 10),
 };
 
-bool CheckSignatureEncoding(const std::vector<unsigned char> &vchSig, unsigned int flags, ScriptError* serror);
+bool CheckSignatureEncoding(const CScriptStackValue &vchSig, unsigned int flags, ScriptError* serror);
+
+/**
+ * Serialized parts of a transaction that the signature hashes of all its
+ * inputs share, computed once per transaction so that checking an input
+ * doesn't re-serialize the whole transaction.
+ *
+ * The signature hash covers the transaction with the other inputs' scripts
+ * blanked, so for SIGHASH_ALL two inputs' hashes only differ in the script
+ * of the input being signed. Kept here are the hasher state after everything
+ * that precedes each input, and the bytes that follow it: the blanked inputs
+ * after it, the outputs and nLockTime. Other hash types don't use it.
+ */
+class PrecomputedTransactionData
+{
+public:
+    //! Hasher state after nVersion and the blanked inputs before each input
+    std::vector<CHashWriter> vPrefix;
+    //! Blanked serialization of each input, BLANKED_INPUT_SIZE bytes each
+    std::vector<unsigned char> vchInputs;
+    //! Serialized outputs and nLockTime
+    std::vector<unsigned char> vchTail;
 
-uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+    //! Size of a serialized input with an empty script
+    static const size_t BLANKED_INPUT_SIZE = 36 + 1 + 4;
+
+    explicit PrecomputedTransactionData(const CTransaction& tx);
+};
+
+/** Signature hash of an input. If given, cache must have been computed from txTo. */
+uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* cache = NULL);
 
 class BaseSignatureChecker
 {
 public:
-    virtual bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const
+    virtual bool CheckSig(const CScriptStackValue& scriptSig, const CScriptStackValue& vchPubKey, const CScript& scriptCode) const
     {
         return false;
     }
@@ -118,13 +147,14 @@ class TransactionSignatureChecker : public BaseSignatureChecker
 private:
     const CTransaction* txTo;
     unsigned int nIn;
+    const PrecomputedTransactionData* txdata;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 
 public:
-    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn) : txTo(txToIn), nIn(nInIn) {}
-    bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const;
+    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const PrecomputedTransactionData* txdataIn = NULL) : txTo(txToIn), nIn(nInIn), txdata(txdataIn) {}
+    bool CheckSig(const CScriptStackValue& scriptSig, const CScriptStackValue& vchPubKey, const CScript& scriptCode) const;
     bool CheckLockTime(const CScriptNum& nLockTime) const;
     bool CheckSequence(const CScriptNum& nSequence) const;
 };
@@ -138,7 +168,24 @@ public:
     MutableTransactionSignatureChecker(const CMutableTransaction* txToIn, unsigned int nInIn) : TransactionSignatureChecker(&txTo, nInIn), txTo(*txToIn) {}
 };
 
+/**
+ * The script execution stack. Its elements, and as many of them as typical
+ * scripts use, are stored inline, so that evaluating them doesn't allocate.
+ */
+typedef prevector<12, CScriptStackValue> CScriptStack;
+
+bool EvalScript(CScriptStack& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* error = NULL);
+/** EvalScript() on a stack of vectors, for callers outside of validation */
 bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* error = NULL);
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* error = NULL);
 
+/**
+ * Verify a spend of a pay-to-pubkey-hash, pay-to-pubkey, bare multisig or
+ * pay-to-script-hash output with one of those as redeem script, with a
+ * scriptSig of data pushes, without running the interpreter. Returns true
+ * only if VerifyScript would succeed; false means it must be asked. Used by
+ * VerifyScript, and exposed for tests.
+ */
+bool VerifyStandardScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker);
+
 #endif // BITCOIN_SCRIPT_INTERPRETER_H
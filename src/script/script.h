@@ -8,6 +8,7 @@
 
 #include "crypto/common.h"
 #include "prevector.h"
+#include "serialize.h"
 
 #include <assert.h>
 #include <climits>
@@ -189,6 +190,13 @@ enum opcodetype
 
 const char* GetOpName(opcodetype opcode);
 
+/**
+ * An element of the script execution stack. Elements of up to 75 bytes, the
+ * largest direct push, are stored inline, so signatures, public keys, hashes
+ * and numbers don't need a heap allocation.
+ */
+typedef prevector<75, unsigned char> CScriptStackValue;
+
 class scriptnum_error : public std::runtime_error
 {
 public:
@@ -214,7 +222,9 @@ public:
 
     static const size_t nDefaultMaxNumSize = 4;
 
-    explicit CScriptNum(const std::vector<unsigned char>& vch, bool fRequireMinimal,
+    /** Decode a number from a std::vector or a CScriptStackValue. */
+    template <typename T>
+    explicit CScriptNum(const T& vch, bool fRequireMinimal,
                         const size_t nMaxNumSize = nDefaultMaxNumSize)
     {
         if (vch.size() > nMaxNumSize) {
@@ -316,12 +326,27 @@ public:
         return serialize(m_value);
     }
 
+    /** Encode into a CScriptStackValue (or a std::vector). */
+    template <typename T>
+    void getvch(T& vch) const
+    {
+        serialize(m_value, vch);
+    }
+
     static std::vector<unsigned char> serialize(const int64_t& value)
     {
+        std::vector<unsigned char> result;
+        serialize(value, result);
+        return result;
+    }
+
+    template <typename T>
+    static void serialize(const int64_t& value, T& result)
+    {
+        result.clear();
         if(value == 0)
-            return std::vector<unsigned char>();
+            return;
 
-        std::vector<unsigned char> result;
         const bool neg = value < 0;
         uint64_t absvalue = neg ? -value : value;
 
@@ -345,12 +370,11 @@ public:
             result.push_back(neg ? 0x80 : 0);
         else if (neg)
             result.back() |= 0x80;
-
-        return result;
     }
 
 private:
-    static int64_t set_vch(const std::vector<unsigned char>& vch)
+    template <typename T>
+    static int64_t set_vch(const T& vch)
     {
       if (vch.empty())
           return 0;
@@ -392,11 +416,42 @@ protected:
         }
         return *this;
     }
+
+    template <typename T>
+    CScript& push_data(const T& b)
+    {
+        if (b.size() < OP_PUSHDATA1)
+        {
+            insert(end(), (unsigned char)b.size());
+        }
+        else if (b.size() <= 0xff)
+        {
+            insert(end(), OP_PUSHDATA1);
+            insert(end(), (unsigned char)b.size());
+        }
+        else if (b.size() <= 0xffff)
+        {
+            insert(end(), OP_PUSHDATA2);
+            uint8_t data[2];
+            WriteLE16(data, b.size());
+            insert(end(), data, data + sizeof(data));
+        }
+        else
+        {
+            insert(end(), OP_PUSHDATA4);
+            uint8_t data[4];
+            WriteLE32(data, b.size());
+            insert(end(), data, data + sizeof(data));
+        }
+        insert(end(), b.begin(), b.end());
+        return *this;
+    }
 public:
     CScript() { }
     CScript(const CScript& b) : CScriptBase(b.begin(), b.end()) { }
     CScript(const_iterator pbegin, const_iterator pend) : CScriptBase(pbegin, pend) { }
     CScript(std::vector<unsigned char>::const_iterator pbegin, std::vector<unsigned char>::const_iterator pend) : CScriptBase(pbegin, pend) { }
+    CScript(CScriptStackValue::const_iterator pbegin, CScriptStackValue::const_iterator pend) : CScriptBase(pbegin, pend) { }
     CScript(const unsigned char* pbegin, const unsigned char* pend) : CScriptBase(pbegin, pend) { }
 
     CScript& operator+=(const CScript& b)
@@ -417,6 +472,7 @@ public:
     explicit CScript(opcodetype b)     { operator<<(b); }
     explicit CScript(const CScriptNum& b) { operator<<(b); }
     explicit CScript(const std::vector<unsigned char>& b) { operator<<(b); }
+    explicit CScript(const CScriptStackValue& b) { operator<<(b); }
 
 
     CScript& operator<<(int64_t b) { return push_int64(b); }
@@ -435,34 +491,8 @@ public:
         return *this;
     }
 
-    CScript& operator<<(const std::vector<unsigned char>& b)
-    {
-        if (b.size() < OP_PUSHDATA1)
-        {
-            insert(end(), (unsigned char)b.size());
-        }
-        else if (b.size() <= 0xff)
-        {
-            insert(end(), OP_PUSHDATA1);
-            insert(end(), (unsigned char)b.size());
-        }
-        else if (b.size() <= 0xffff)
-        {
-            insert(end(), OP_PUSHDATA2);
-            uint8_t data[2];
-            WriteLE16(data, b.size());
-            insert(end(), data, data + sizeof(data));
-        }
-        else
-        {
-            insert(end(), OP_PUSHDATA4);
-            uint8_t data[4];
-            WriteLE32(data, b.size());
-            insert(end(), data, data + sizeof(data));
-        }
-        insert(end(), b.begin(), b.end());
-        return *this;
-    }
+    CScript& operator<<(const std::vector<unsigned char>& b) { return push_data(b); }
+    CScript& operator<<(const CScriptStackValue& b) { return push_data(b); }
 
     CScript& operator<<(const CScript& b)
     {
@@ -485,7 +515,7 @@ public:
     bool GetOp(iterator& pc, opcodetype& opcodeRet)
     {
          const_iterator pc2 = pc;
-         bool fRet = GetOp2(pc2, opcodeRet, NULL);
+         bool fRet = GetOp2(pc2, opcodeRet, (std::vector<unsigned char>*)NULL);
          pc = begin() + (pc2 - begin());
          return fRet;
     }
@@ -495,12 +525,19 @@ public:
         return GetOp2(pc, opcodeRet, &vchRet);
     }
 
+    bool GetOp(const_iterator& pc, opcodetype& opcodeRet, CScriptStackValue& vchRet) const
+    {
+        return GetOp2(pc, opcodeRet, &vchRet);
+    }
+
     bool GetOp(const_iterator& pc, opcodetype& opcodeRet) const
     {
-        return GetOp2(pc, opcodeRet, NULL);
+        return GetOp2(pc, opcodeRet, (std::vector<unsigned char>*)NULL);
     }
 
-    bool GetOp2(const_iterator& pc, opcodetype& opcodeRet, std::vector<unsigned char>* pvchRet) const
+    /** Read an opcode, and the data it pushes into a std::vector or a CScriptStackValue. */
+    template <typename T>
+    bool GetOp2(const_iterator& pc, opcodetype& opcodeRet, T* pvchRet) const
     {
         opcodeRet = OP_INVALIDOPCODE;
         if (pvchRet)
@@ -641,6 +678,12 @@ public:
         // The default std::vector::clear() does not release memory.
         CScriptBase().swap(*this);
     }
+
+    /** Size when serialized as a CScriptBase: the compact size length prefix and the bytes. */
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return GetSizeOfCompactSize(size()) + size();
+    }
 };
 
 class CReserveScript
@@ -185,7 +185,7 @@ static CScript CombineMultisig(const CScript& scriptPubKey, const BaseSignatureC
             if (sigs.count(pubkey))
                 continue; // Already got a sig for this pubkey
 
-            if (checker.CheckSig(sig, pubkey, scriptPubKey))
+            if (checker.CheckSig(CScriptStackValue(sig.begin(), sig.end()), CScriptStackValue(pubkey.begin(), pubkey.end()), scriptPubKey))
             {
                 sigs[pubkey] = sig;
                 break;
@@ -284,7 +284,7 @@ class DummySignatureChecker : public BaseSignatureChecker
 public:
     DummySignatureChecker() {}
 
-    bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const
+    bool CheckSig(const CScriptStackValue& scriptSig, const CScriptStackValue& vchPubKey, const CScript& scriptCode) const
     {
         return true;
     }
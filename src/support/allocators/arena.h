@@ -0,0 +1,166 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_ARENA_H
+#define BITCOIN_SUPPORT_ALLOCATORS_ARENA_H
+
+#include <atomic>
+#include <new>
+#include <stddef.h>
+#include <stdlib.h>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Memory handed out by bumping a pointer through a few large chunks, which
+ * are freed together when the last arena_allocator using the arena goes away.
+ * Freeing a single allocation does nothing.
+ *
+ * Allocation is not thread-safe, so an arena should only be allocated from
+ * while filling it (e.g. while deserializing a block); the reference count is.
+ */
+class CArena
+{
+public:
+    static const size_t FIRST_CHUNK_SIZE = 64 * 1024;
+    static const size_t MAX_CHUNK_SIZE = 1024 * 1024;
+    static const size_t ALIGNMENT = 2 * sizeof(void*);
+
+    CArena() : pNext(NULL), nAvail(0), nNextChunkSize(FIRST_CHUNK_SIZE), nChunkBytes(0), nRefCount(0) {}
+
+    ~CArena()
+    {
+        for (size_t i = 0; i < vChunks.size(); i++)
+            free(vChunks[i]);
+    }
+
+    void* Allocate(size_t nSize)
+    {
+        nSize = (nSize + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        if (nSize > nAvail) {
+            // Start a new chunk, growing them up to MAX_CHUNK_SIZE; what is
+            // left of the current one is wasted.
+            size_t nChunkSize = nNextChunkSize < nSize ? nSize : nNextChunkSize;
+            char* pChunk = static_cast<char*>(malloc(nChunkSize));
+            if (!pChunk)
+                throw std::bad_alloc();
+            vChunks.push_back(pChunk);
+            nChunkBytes += nChunkSize;
+            pNext = pChunk;
+            nAvail = nChunkSize;
+            if (nNextChunkSize < MAX_CHUNK_SIZE)
+                nNextChunkSize *= 2;
+        }
+        void* p = pNext;
+        pNext += nSize;
+        nAvail -= nSize;
+        return p;
+    }
+
+    /** Total size of the chunks */
+    size_t GetChunkBytes() const { return nChunkBytes; }
+
+    void AddRef() { nRefCount++; }
+    void Release()
+    {
+        if (--nRefCount == 0)
+            delete this;
+    }
+
+private:
+    std::vector<char*> vChunks;
+    char* pNext;
+    size_t nAvail;
+    size_t nNextChunkSize;
+    size_t nChunkBytes;
+    std::atomic<int> nRefCount;
+
+    CArena(const CArena&);
+    CArena& operator=(const CArena&);
+};
+
+//
+// Allocator that takes its memory from a CArena, and keeps that arena alive
+// as long as it (or a copy of it) exists. A default constructed one uses the
+// heap instead.
+//
+// Containers copied from one using an arena use the heap, so that a copy
+// doesn't keep the whole arena alive.
+//
+template <typename T>
+class arena_allocator
+{
+public:
+    typedef T value_type;
+    typedef std::false_type propagate_on_container_copy_assignment;
+    typedef std::false_type propagate_on_container_move_assignment;
+    typedef std::false_type propagate_on_container_swap;
+    template <typename _Other>
+    struct rebind {
+        typedef arena_allocator<_Other> other;
+    };
+
+    arena_allocator() throw() : arena(NULL) {}
+    explicit arena_allocator(CArena* arenaIn) throw() : arena(arenaIn)
+    {
+        if (arena)
+            arena->AddRef();
+    }
+    arena_allocator(const arena_allocator& a) throw() : arena(a.arena)
+    {
+        if (arena)
+            arena->AddRef();
+    }
+    template <typename U>
+    arena_allocator(const arena_allocator<U>& a) throw() : arena(a.GetArena())
+    {
+        if (arena)
+            arena->AddRef();
+    }
+    ~arena_allocator() throw()
+    {
+        if (arena)
+            arena->Release();
+    }
+
+    arena_allocator& operator=(const arena_allocator& a) throw()
+    {
+        if (a.arena)
+            a.arena->AddRef();
+        if (arena)
+            arena->Release();
+        arena = a.arena;
+        return *this;
+    }
+
+    T* allocate(std::size_t n)
+    {
+        if (arena)
+            return static_cast<T*>(arena->Allocate(sizeof(T) * n));
+        return static_cast<T*>(::operator new(sizeof(T) * n));
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        if (!arena)
+            ::operator delete(p);
+    }
+
+    arena_allocator select_on_container_copy_construction() const
+    {
+        return arena_allocator();
+    }
+
+    CArena* GetArena() const { return arena; }
+
+    template <typename U>
+    bool operator==(const arena_allocator<U>& a) const { return arena == a.GetArena(); }
+    template <typename U>
+    bool operator!=(const arena_allocator<U>& a) const { return arena != a.GetArena(); }
+
+private:
+    CArena* arena;
+};
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_ARENA_H
@@ -0,0 +1,60 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOLED_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOLED_H
+
+#include "support/bufferpool.h"
+
+#include <memory>
+#include <vector>
+
+//
+// Allocator that takes its memory from CBufferPool, and gives it back there
+// without clearing it. Only for public data.
+//
+template <typename T>
+struct pooled_allocator : public std::allocator<T> {
+    // MSVC8 default copy constructor is broken
+    typedef std::allocator<T> base;
+    typedef typename base::size_type size_type;
+    typedef typename base::difference_type difference_type;
+    typedef typename base::pointer pointer;
+    typedef typename base::const_pointer const_pointer;
+    typedef typename base::reference reference;
+    typedef typename base::const_reference const_reference;
+    typedef typename base::value_type value_type;
+    pooled_allocator() throw() {}
+    pooled_allocator(const pooled_allocator& a) throw() : base(a) {}
+    template <typename U>
+    pooled_allocator(const pooled_allocator<U>& a) throw() : base(a)
+    {
+    }
+    ~pooled_allocator() throw() {}
+    template <typename _Other>
+    struct rebind {
+        typedef pooled_allocator<_Other> other;
+    };
+
+    T* allocate(std::size_t n, const void* hint = 0)
+    {
+        // Small buffers aren't pooled, don't bother the pool with them
+        if (sizeof(T) * n < CBufferPool::MIN_POOLED_SIZE)
+            return static_cast<T*>(::operator new(sizeof(T) * n));
+        return static_cast<T*>(CBufferPool::Instance().Allocate(sizeof(T) * n));
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        if (sizeof(T) * n < CBufferPool::MIN_POOLED_SIZE)
+            ::operator delete(p);
+        else if (p != NULL)
+            CBufferPool::Instance().Deallocate(p, sizeof(T) * n);
+    }
+};
+
+// Byte-vector from the buffer pool, not cleared before deletion.
+typedef std::vector<char, pooled_allocator<char> > CPooledSerializeData;
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOLED_H
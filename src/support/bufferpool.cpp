@@ -0,0 +1,63 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "support/bufferpool.h"
+
+#include <new>
+
+CBufferPool* CBufferPool::_instance = NULL;
+boost::once_flag CBufferPool::init_flag = BOOST_ONCE_INIT;
+
+CBufferPool::CBufferPool() : nCachedBytes(0)
+{
+    vFree.resize(GetSizeClass(MAX_POOLED_SIZE) + 1);
+}
+
+int CBufferPool::GetSizeClass(size_t nSize)
+{
+    if (nSize < MIN_POOLED_SIZE || nSize > MAX_POOLED_SIZE)
+        return -1;
+    int nClass = 0;
+    while ((MIN_POOLED_SIZE << nClass) < nSize)
+        nClass++;
+    return nClass;
+}
+
+void* CBufferPool::Allocate(size_t nSize)
+{
+    int nClass = GetSizeClass(nSize);
+    if (nClass < 0)
+        return ::operator new(nSize);
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        std::vector<void*>& vClass = vFree[nClass];
+        if (!vClass.empty()) {
+            void* p = vClass.back();
+            vClass.pop_back();
+            nCachedBytes -= MIN_POOLED_SIZE << nClass;
+            return p;
+        }
+    }
+    return ::operator new(MIN_POOLED_SIZE << nClass);
+}
+
+void CBufferPool::Deallocate(void* p, size_t nSize)
+{
+    int nClass = GetSizeClass(nSize);
+    if (nClass >= 0) {
+        boost::mutex::scoped_lock lock(mutex);
+        if (nCachedBytes + (MIN_POOLED_SIZE << nClass) <= MAX_CACHED_BYTES) {
+            vFree[nClass].push_back(p);
+            nCachedBytes += MIN_POOLED_SIZE << nClass;
+            return;
+        }
+    }
+    ::operator delete(p);
+}
+
+size_t CBufferPool::GetCachedBytes()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return nCachedBytes;
+}
@@ -0,0 +1,65 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_BUFFERPOOL_H
+#define BITCOIN_SUPPORT_BUFFERPOOL_H
+
+#include <stddef.h>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/once.hpp>
+
+/**
+ * Thread-safe cache of freed buffers, for use by pooled_allocator.
+ *
+ * Buffers of MIN_POOLED_SIZE to MAX_POOLED_SIZE bytes are rounded up to a
+ * power of two, and when freed are kept in a free list for their size class,
+ * up to MAX_CACHED_BYTES in total, so that buffers which are allocated and
+ * freed over and over (network messages, serialized blocks) are reused
+ * instead of going back to the heap. Smaller buffers, which the heap hands
+ * out quickly anyway, aren't pooled. Freed buffers are not cleared: only use
+ * it for public data.
+ */
+class CBufferPool
+{
+public:
+    static const size_t MIN_POOLED_SIZE = 4096;
+    static const size_t MAX_POOLED_SIZE = 4 * 1024 * 1024;
+    static const size_t MAX_CACHED_BYTES = 16 * 1024 * 1024;
+
+    static CBufferPool& Instance()
+    {
+        boost::call_once(CBufferPool::CreateInstance, CBufferPool::init_flag);
+        return *CBufferPool::_instance;
+    }
+
+    void* Allocate(size_t nSize);
+    void Deallocate(void* p, size_t nSize);
+
+    /** Total size of the freed buffers being held */
+    size_t GetCachedBytes();
+
+private:
+    CBufferPool();
+
+    /** Size class of an allocation, or -1 if it isn't pooled */
+    static int GetSizeClass(size_t nSize);
+
+    static void CreateInstance()
+    {
+        // Never destroyed, as buffers may still be freed by other static
+        // destructors at exit.
+        CBufferPool::_instance = new CBufferPool();
+    }
+
+    static CBufferPool* _instance;
+    static boost::once_flag init_flag;
+
+    boost::mutex mutex;
+    std::vector<std::vector<void*> > vFree;
+    size_t nCachedBytes;
+};
+
+#endif // BITCOIN_SUPPORT_BUFFERPOOL_H
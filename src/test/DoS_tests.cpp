@@ -23,15 +23,18 @@
 #include <boost/test/unit_test.hpp>
 
 // Tests this internal-to-main.cpp method:
-extern bool AddOrphanTx(const CTransaction& tx, NodeId peer);
+extern bool AddOrphanTx(const CTransactionRef& tx, NodeId peer);
 extern void EraseOrphansFor(NodeId peer);
-extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
+extern unsigned int LimitOrphanTxSize(size_t nMaxOrphanTxSize);
 struct COrphanTx {
-    CTransaction tx;
+    CTransactionRef tx;
     NodeId fromPeer;
+    int64_t nTimeExpire;
+    unsigned int nMissingInputs;
 };
 extern std::map<uint256, COrphanTx> mapOrphanTransactions;
-extern std::map<uint256, std::set<uint256> > mapOrphanTransactionsByPrev;
+extern std::map<COutPoint, std::set<uint256> > mapOrphanTransactionsByPrev;
+extern size_t nOrphanTxMemoryUsage;
 
 CService ip(uint32_t i)
 {
@@ -111,7 +114,7 @@ CTransaction RandomOrphan()
     it = mapOrphanTransactions.lower_bound(GetRandHash());
     if (it == mapOrphanTransactions.end())
         it = mapOrphanTransactions.begin();
-    return it->second.tx;
+    return *it->second.tx;
 }
 
 BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
@@ -133,7 +136,7 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         tx.vout[0].nValue = 1*CENT;
         tx.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
 
-        AddOrphanTx(tx, i);
+        AddOrphanTx(MakeTransactionRef(tx), i);
     }
 
     // ... and 50 that depend on other orphans:
@@ -150,7 +153,7 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         tx.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
         SignSignature(keystore, txPrev, tx, 0);
 
-        AddOrphanTx(tx, i);
+        AddOrphanTx(MakeTransactionRef(tx), i);
     }
 
     // This really-big orphan should be ignored:
@@ -174,7 +177,7 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         for (unsigned int j = 1; j < tx.vin.size(); j++)
             tx.vin[j].scriptSig = tx.vin[0].scriptSig;
 
-        BOOST_CHECK(!AddOrphanTx(tx, i));
+        BOOST_CHECK(!AddOrphanTx(MakeTransactionRef(tx), i));
     }
 
     // Test EraseOrphansFor:
@@ -185,14 +188,53 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         BOOST_CHECK(mapOrphanTransactions.size() < sizeBefore);
     }
 
+    // Every orphan is indexed by the outpoints it is missing:
+    BOOST_FOREACH(const PAIRTYPE(uint256, COrphanTx)& item, mapOrphanTransactions)
+    {
+        BOOST_CHECK_EQUAL(item.second.nMissingInputs, 1U);
+        const COutPoint& prevout = item.second.tx->vin[0].prevout;
+        BOOST_CHECK(mapOrphanTransactionsByPrev.count(prevout));
+        BOOST_CHECK(mapOrphanTransactionsByPrev[prevout].count(item.first));
+    }
+
     // Test LimitOrphanTxSize() function:
-    LimitOrphanTxSize(40);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 40);
-    LimitOrphanTxSize(10);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 10);
+    size_t nUsage = nOrphanTxMemoryUsage;
+    LimitOrphanTxSize(nUsage / 2);
+    BOOST_CHECK(nOrphanTxMemoryUsage <= nUsage / 2);
+    BOOST_CHECK(!mapOrphanTransactions.empty());
+    LimitOrphanTxSize(nUsage / 10);
+    BOOST_CHECK(nOrphanTxMemoryUsage <= nUsage / 10);
     LimitOrphanTxSize(0);
     BOOST_CHECK(mapOrphanTransactions.empty());
     BOOST_CHECK(mapOrphanTransactionsByPrev.empty());
+    BOOST_CHECK_EQUAL(nOrphanTxMemoryUsage, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_mapOrphans_expiry)
+{
+    int64_t nStartTime = GetTime();
+    SetMockTime(nStartTime);
+
+    for (int i = 0; i < 10; i++)
+    {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.n = 0;
+        tx.vin[0].prevout.hash = GetRandHash();
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1*CENT;
+        BOOST_CHECK(AddOrphanTx(MakeTransactionRef(tx), i));
+    }
+
+    // Nothing has expired yet, and the pool is within its memory limit:
+    LimitOrphanTxSize(std::numeric_limits<size_t>::max());
+    BOOST_CHECK_EQUAL(mapOrphanTransactions.size(), 10U);
+
+    SetMockTime(nStartTime + ORPHAN_TX_EXPIRE_TIME + ORPHAN_TX_EXPIRE_INTERVAL + 1);
+    LimitOrphanTxSize(std::numeric_limits<size_t>::max());
+    BOOST_CHECK(mapOrphanTransactions.empty());
+    BOOST_CHECK(mapOrphanTransactionsByPrev.empty());
+    SetMockTime(0);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,106 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addrindex.h"
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "main.h"
+#include "script/standard.h"
+#include "test/test_bitcoin.h"
+#include "utiltime.h"
+#include "validationinterface.h"
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addrindex_tests, TestChain100Setup)
+
+static bool WaitForSync(const CAddrIndex& addrindex)
+{
+    for (int i = 0; i < 1000; i++) {
+        {
+            LOCK(cs_main);
+            if (addrindex.IsSynced())
+                return true;
+        }
+        MilliSleep(10);
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(addrindex_sync)
+{
+    CAddrIndex addrindex(1 << 20, true);
+    BOOST_CHECK(addrindex.Init());
+    RegisterValidationInterface(&addrindex);
+    boost::thread thread(boost::bind(&CAddrIndex::Thread, &addrindex));
+    BOOST_CHECK(WaitForSync(addrindex));
+
+    // All the coinbases of the test chain pay to the same key, in order
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    std::vector<std::pair<COutPoint, CAddrIndexEntry> > vOutputs;
+    BOOST_CHECK(addrindex.FindOutputs(scriptPubKey, NULL, 1000, vOutputs));
+    BOOST_CHECK_EQUAL(vOutputs.size(), coinbaseTxns.size());
+    for (unsigned int i = 0; i < vOutputs.size(); i++) {
+        BOOST_CHECK(vOutputs[i].first == COutPoint(coinbaseTxns[i].GetHash(), 0));
+        BOOST_CHECK_EQUAL(vOutputs[i].second.nHeight, i + 1);
+        BOOST_CHECK_EQUAL(vOutputs[i].second.nValue, coinbaseTxns[i].vout[0].nValue);
+        BOOST_CHECK(!vOutputs[i].second.IsSpent());
+    }
+
+    // Paging continues after the given output
+    std::vector<std::pair<COutPoint, CAddrIndexEntry> > vPage;
+    CAddrIndexPos pos(vOutputs[9].second.nHeight, vOutputs[9].first);
+    BOOST_CHECK(addrindex.FindOutputs(scriptPubKey, &pos, 5, vPage));
+    BOOST_CHECK_EQUAL(vPage.size(), 5U);
+    BOOST_CHECK(vPage[0].first == vOutputs[10].first);
+    BOOST_CHECK(vPage[4].first == vOutputs[14].first);
+
+    // Spend the first coinbase to another key
+    CKey key;
+    key.MakeNewKey(true);
+    CScript scriptPubKeyNew = GetScriptForDestination(key.GetPubKey().GetID());
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey = scriptPubKeyNew;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+    CBlock block = CreateAndProcessBlock(std::vector<CMutableTransaction>(1, spend), scriptPubKeyNew);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    BOOST_CHECK(WaitForSync(addrindex));
+
+    CAddrIndexEntry entry;
+    CAddrIndexKey keyFirst(CAddrIndex::GetScriptHash(scriptPubKey), COutPoint(coinbaseTxns[0].GetHash(), 0));
+    BOOST_CHECK(addrindex.GetDB().ReadEntry(keyFirst, entry));
+    BOOST_CHECK(entry.spentBy == COutPoint(spend.GetHash(), 0));
+    BOOST_CHECK_EQUAL(entry.nSpentHeight, 101);
+    BOOST_CHECK(addrindex.FindOutputs(scriptPubKeyNew, NULL, 1000, vOutputs));
+    BOOST_CHECK_EQUAL(vOutputs.size(), 2U);
+
+    // Disconnecting the block removes its outputs and unspends the coinbase
+    CValidationState state;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(InvalidateBlock(state, Params(), chainActive.Tip()));
+    }
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    BOOST_CHECK(WaitForSync(addrindex));
+    BOOST_CHECK(addrindex.GetDB().ReadEntry(keyFirst, entry));
+    BOOST_CHECK(!entry.IsSpent());
+    BOOST_CHECK(addrindex.FindOutputs(scriptPubKeyNew, NULL, 1000, vOutputs));
+    BOOST_CHECK(vOutputs.empty());
+
+    thread.interrupt();
+    thread.join();
+    UnregisterValidationInterface(&addrindex);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 
 #include "util.h"
 
+#include "support/allocators/pooled.h"
 #include "support/allocators/secure.h"
 #include "test/test_bitcoin.h"
 
@@ -117,4 +118,37 @@ BOOST_AUTO_TEST_CASE(test_LockedPageManagerBase)
     BOOST_CHECK((last_unlock_len & (test_page_size-1)) == 0); // always unlock entire pages
 }
 
+BOOST_AUTO_TEST_CASE(test_BufferPool)
+{
+    CBufferPool& pool = CBufferPool::Instance();
+
+    // A freed buffer is handed out again for any size of its class
+    void* p = pool.Allocate(5000);
+    size_t nCached = pool.GetCachedBytes();
+    BOOST_REQUIRE(nCached + 8192 <= CBufferPool::MAX_CACHED_BYTES);
+    pool.Deallocate(p, 5000);
+    BOOST_CHECK_EQUAL(pool.GetCachedBytes(), nCached + 8192);
+    void* p2 = pool.Allocate(8192);
+    BOOST_CHECK(p2 == p);
+    BOOST_CHECK_EQUAL(pool.GetCachedBytes(), nCached);
+    pool.Deallocate(p2, 8192);
+
+    // Small and oversized buffers go straight back to the heap
+    nCached = pool.GetCachedBytes();
+    p = pool.Allocate(CBufferPool::MIN_POOLED_SIZE - 1);
+    pool.Deallocate(p, CBufferPool::MIN_POOLED_SIZE - 1);
+    p = pool.Allocate(CBufferPool::MAX_POOLED_SIZE + 1);
+    pool.Deallocate(p, CBufferPool::MAX_POOLED_SIZE + 1);
+    BOOST_CHECK_EQUAL(pool.GetCachedBytes(), nCached);
+
+    // Vectors using pooled_allocator reuse them too
+    const char* pData;
+    {
+        CPooledSerializeData v(6000, 'a');
+        pData = &v[0];
+    }
+    CPooledSerializeData v(5000, 'b');
+    BOOST_CHECK(&v[0] == pData);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,99 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+#include "streams.h"
+#include "version.h"
+
+#include "test/test_bitcoin.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcache_tests, BasicTestingSetup)
+
+static CBlock MakeBlock(uint32_t nNonce, unsigned int nTx)
+{
+    CBlock block;
+    block.nNonce = nNonce;
+    for (unsigned int i = 0; i < nTx; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.n = i;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << std::vector<unsigned char>(100, i);
+        block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_lookup)
+{
+    CBlockCache cache;
+    CBlock block = MakeBlock(1, 10);
+    CBlock blockOut;
+    std::vector<unsigned char> vchBlock;
+    BOOST_CHECK(!cache.Get(block.GetHash(), blockOut));
+    BOOST_CHECK(!cache.GetRaw(block.GetHash(), vchBlock));
+    BOOST_CHECK_EQUAL(cache.GetMisses(), 2U);
+
+    cache.Add(block);
+    cache.Add(block);
+    BOOST_CHECK_EQUAL(cache.size(), 1U);
+    BOOST_CHECK(cache.Get(block.GetHash(), blockOut));
+    BOOST_CHECK(blockOut.GetHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(blockOut.vtx.size(), 10U);
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+    BOOST_CHECK(cache.GetRaw(block.GetHash(), vchBlock));
+    BOOST_CHECK(std::vector<unsigned char>(ss.begin(), ss.end()) == vchBlock);
+    BOOST_CHECK_EQUAL(cache.GetHits(), 2U);
+
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.size(), 0U);
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), 0U);
+    BOOST_CHECK(!cache.Get(block.GetHash(), blockOut));
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_eviction)
+{
+    std::vector<CBlock> vBlocks;
+    for (unsigned int i = 0; i < 4; i++)
+        vBlocks.push_back(MakeBlock(i, 20));
+
+    // Size the cache to hold exactly three of the blocks.
+    CBlockCache cache;
+    cache.Add(vBlocks[0]);
+    size_t nEntryUsage = cache.DynamicMemoryUsage();
+    BOOST_CHECK(nEntryUsage > 20 * 100);
+    cache.SetMaxUsage(3 * nEntryUsage);
+
+    cache.Add(vBlocks[1]);
+    cache.Add(vBlocks[2]);
+    BOOST_CHECK_EQUAL(cache.size(), 3U);
+
+    // Touch block 0, so block 1 is now the least recently used.
+    CBlock blockOut;
+    BOOST_CHECK(cache.Get(vBlocks[0].GetHash(), blockOut));
+    cache.Add(vBlocks[3]);
+    BOOST_CHECK_EQUAL(cache.size(), 3U);
+    BOOST_CHECK(!cache.Get(vBlocks[1].GetHash(), blockOut));
+    BOOST_CHECK(cache.Get(vBlocks[0].GetHash(), blockOut));
+    BOOST_CHECK(cache.Get(vBlocks[2].GetHash(), blockOut));
+    BOOST_CHECK(cache.Get(vBlocks[3].GetHash(), blockOut));
+    BOOST_CHECK(cache.DynamicMemoryUsage() <= 3 * nEntryUsage);
+
+    // Shrinking the limit evicts right away, and 0 disables the cache.
+    cache.SetMaxUsage(nEntryUsage);
+    BOOST_CHECK_EQUAL(cache.size(), 1U);
+    BOOST_CHECK(cache.Get(vBlocks[3].GetHash(), blockOut));
+    cache.SetMaxUsage(0);
+    BOOST_CHECK_EQUAL(cache.size(), 0U);
+    cache.Add(vBlocks[0]);
+    BOOST_CHECK_EQUAL(cache.size(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
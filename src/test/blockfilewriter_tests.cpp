@@ -0,0 +1,88 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilewriter.h"
+#include "main.h"
+
+#include "test/test_bitcoin.h"
+
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilewriter_tests, TestingSetup)
+
+static std::vector<unsigned char> MakeRecord(unsigned char c, size_t nSize)
+{
+    // 8 byte header followed by the record data
+    std::vector<unsigned char> vch(8, 0xff);
+    vch.resize(8 + nSize, c);
+    return vch;
+}
+
+static std::vector<unsigned char> ReadFile(const CDiskBlockPos& pos, bool fUndo, size_t nSize)
+{
+    std::vector<unsigned char> vch(nSize);
+    FILE* file = fUndo ? OpenUndoFile(pos, true) : OpenBlockFile(pos, true);
+    BOOST_REQUIRE(file);
+    BOOST_CHECK_EQUAL(fread(&vch[0], 1, nSize, file), nSize);
+    fclose(file);
+    return vch;
+}
+
+static void CheckWrites(CBlockFileWriter& writer, int nFile)
+{
+    // Two block records back to back, and one undo record.
+    std::vector<unsigned char> vch;
+    vch = MakeRecord(1, 100);
+    writer.Write(CDiskBlockPos(nFile, 8), false, vch);
+    BOOST_CHECK(vch.empty());
+    vch = MakeRecord(2, 50);
+    writer.Write(CDiskBlockPos(nFile, 116), false, vch);
+    vch = MakeRecord(3, 30);
+    writer.Write(CDiskBlockPos(nFile, 8), true, vch);
+
+    // Queued records are readable before they're written. Once synced, they
+    // must be on disk instead.
+    std::vector<unsigned char> vchPending;
+    if (writer.GetPending(CDiskBlockPos(nFile, 116), false, vchPending))
+        BOOST_CHECK(vchPending == std::vector<unsigned char>(50, 2));
+    writer.Commit(nFile, 166, 38, true);
+    BOOST_CHECK(writer.Sync());
+    BOOST_CHECK(!writer.GetPending(CDiskBlockPos(nFile, 8), false, vchPending));
+    BOOST_CHECK(!writer.GetPending(CDiskBlockPos(nFile, 8), true, vchPending));
+
+    BOOST_CHECK(ReadFile(CDiskBlockPos(nFile, 8), false, 100) == std::vector<unsigned char>(100, 1));
+    BOOST_CHECK(ReadFile(CDiskBlockPos(nFile, 116), false, 50) == std::vector<unsigned char>(50, 2));
+    BOOST_CHECK(ReadFile(CDiskBlockPos(nFile, 8), true, 30) == std::vector<unsigned char>(30, 3));
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk")), 166U);
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "rev")), 38U);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilewriter_direct)
+{
+    // Without a thread, jobs are done by the caller.
+    CBlockFileWriter writer;
+    CheckWrites(writer, 1000);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilewriter_thread)
+{
+    CBlockFileWriter writer;
+    boost::thread_group group;
+    group.create_thread(boost::bind(&CBlockFileWriter::Thread, &writer));
+    CheckWrites(writer, 1001);
+
+    // Jobs queued when the thread is stopped are still finished.
+    std::vector<unsigned char> vch = MakeRecord(4, 10);
+    writer.Write(CDiskBlockPos(1002, 8), false, vch);
+    group.interrupt_all();
+    group.join_all();
+    BOOST_CHECK(writer.Sync());
+    BOOST_CHECK(ReadFile(CDiskBlockPos(1002, 8), false, 10) == std::vector<unsigned char>(10, 4));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
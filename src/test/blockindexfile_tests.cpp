@@ -0,0 +1,116 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockindexfile.h"
+#include "chain.h"
+#include "main.h"
+#include "util.h"
+
+#include "test/test_bitcoin.h"
+
+#include <map>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockindexfile_tests, TestChain100Setup)
+
+struct LoadedIndex
+{
+    std::map<uint256, CBlockIndex> mapIndex;
+
+    CBlockIndex* Insert(const uint256& hash)
+    {
+        if (hash.IsNull())
+            return NULL;
+        std::map<uint256, CBlockIndex>::iterator it = mapIndex.insert(std::make_pair(hash, CBlockIndex())).first;
+        it->second.phashBlock = &it->first;
+        return &it->second;
+    }
+};
+
+static void CheckLoaded(const LoadedIndex& loaded, const std::vector<const CBlockIndex*>& vIndex)
+{
+    BOOST_CHECK_EQUAL(loaded.mapIndex.size(), vIndex.size());
+    BOOST_FOREACH(const CBlockIndex* pindex, vIndex) {
+        std::map<uint256, CBlockIndex>::const_iterator it = loaded.mapIndex.find(pindex->GetBlockHash());
+        BOOST_REQUIRE(it != loaded.mapIndex.end());
+        const CBlockIndex& index = it->second;
+        BOOST_CHECK(index.GetBlockHeader().GetHash() == pindex->GetBlockHash());
+        BOOST_CHECK(index.nChainWork == pindex->nChainWork);
+        BOOST_CHECK_EQUAL(index.nHeight, pindex->nHeight);
+        BOOST_CHECK_EQUAL(index.nStatus, pindex->nStatus);
+        BOOST_CHECK_EQUAL(index.nTx, pindex->nTx);
+        BOOST_CHECK_EQUAL(index.nFile, pindex->nFile);
+        BOOST_CHECK_EQUAL(index.nDataPos, pindex->nDataPos);
+        BOOST_CHECK_EQUAL(index.nUndoPos, pindex->nUndoPos);
+        BOOST_CHECK((index.pprev ? index.pprev->GetBlockHash() : uint256()) == (pindex->pprev ? pindex->pprev->GetBlockHash() : uint256()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(blockindexfile_roundtrip)
+{
+    LOCK(cs_main);
+    std::vector<const CBlockIndex*> vIndex;
+    for (CBlockIndex* pindex = chainActive.Tip(); pindex; pindex = pindex->pprev)
+        vIndex.push_back(pindex);
+    std::vector<const CBlockIndex*> vFirst(vIndex.begin(), vIndex.begin() + 50);
+    std::vector<const CBlockIndex*> vRest(vIndex.begin() + 50, vIndex.end());
+
+    boost::filesystem::path path = GetDataDir() / "blockindex_test.dat";
+    uint64_t nNonce, nSize;
+    {
+        CBlockIndexFile file(path);
+        BOOST_CHECK(file.Rewrite(vFirst));
+        BOOST_CHECK(file.Append(vRest));
+        // Appending an entry again adds a record which replaces the first.
+        BOOST_CHECK(file.Append(std::vector<const CBlockIndex*>(1, vIndex[0])));
+        BOOST_CHECK_EQUAL(file.GetRecordCount(), vIndex.size() + 1);
+        nNonce = file.GetNonce();
+        nSize = file.GetSize();
+        BOOST_CHECK_EQUAL(nSize, BLOCK_INDEX_FILE_HEADER_SIZE + (vIndex.size() + 1) * BLOCK_INDEX_FILE_RECORD_SIZE);
+
+        // Records past the size we last committed to are ignored.
+        BOOST_CHECK(file.Append(vFirst));
+    }
+
+    {
+        LoadedIndex loaded;
+        CBlockIndexFile file(path);
+        BOOST_CHECK(file.Load(nNonce, nSize, boost::bind(&LoadedIndex::Insert, &loaded, _1)));
+        CheckLoaded(loaded, vIndex);
+        BOOST_CHECK_EQUAL(boost::filesystem::file_size(path), nSize);
+    }
+
+    // A different generation, or a size that isn't on a record boundary or
+    // past the end of the file, is refused without loading anything.
+    {
+        LoadedIndex loaded;
+        CBlockIndexFile file(path);
+        BOOST_CHECK(!file.Load(nNonce + 1, nSize, boost::bind(&LoadedIndex::Insert, &loaded, _1)));
+        BOOST_CHECK(!file.Load(nNonce, nSize - 1, boost::bind(&LoadedIndex::Insert, &loaded, _1)));
+        BOOST_CHECK(!file.Load(nNonce, nSize + BLOCK_INDEX_FILE_RECORD_SIZE, boost::bind(&LoadedIndex::Insert, &loaded, _1)));
+        BOOST_CHECK(!file.IsOpen());
+        BOOST_CHECK(loaded.mapIndex.empty());
+    }
+
+    // So is a corrupted record.
+    {
+        FILE* f = fopen(path.string().c_str(), "rb+");
+        BOOST_REQUIRE(f);
+        fseek(f, BLOCK_INDEX_FILE_HEADER_SIZE + 10 * BLOCK_INDEX_FILE_RECORD_SIZE + 150, SEEK_SET);
+        fputc(0xff, f);
+        fclose(f);
+        LoadedIndex loaded;
+        CBlockIndexFile file(path);
+        BOOST_CHECK(!file.Load(nNonce, nSize, boost::bind(&LoadedIndex::Insert, &loaded, _1)));
+        BOOST_CHECK(loaded.mapIndex.empty());
+    }
+
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
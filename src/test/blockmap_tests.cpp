@@ -0,0 +1,92 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockmap.h"
+#include "chain.h"
+#include "random.h"
+
+#include "test/test_bitcoin.h"
+
+#include <map>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockmap_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockmap_test)
+{
+    BlockMap map;
+    std::map<uint256, CBlockIndex*> mapExpected;
+    std::vector<CBlockIndex> vIndex(10000);
+
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.begin() == map.end());
+    BOOST_CHECK(map.find(GetRandHash()) == map.end());
+    BOOST_CHECK(map.find(uint256()) == map.end());
+
+    // Enough entries to grow the table several times
+    for (size_t i = 0; i < vIndex.size(); i++) {
+        uint256 hash = GetRandHash();
+        std::pair<BlockMap::iterator, bool> ret = map.insert(std::make_pair(hash, &vIndex[i]));
+        BOOST_CHECK(ret.second);
+        BOOST_CHECK(ret.first->first == hash && ret.first->second == &vIndex[i]);
+        mapExpected[hash] = &vIndex[i];
+    }
+    BOOST_CHECK_EQUAL(map.size(), vIndex.size());
+
+    // Inserting an existing key keeps the old value
+    std::pair<BlockMap::iterator, bool> ret = map.insert(std::make_pair(mapExpected.begin()->first, (CBlockIndex*)NULL));
+    BOOST_CHECK(!ret.second);
+    BOOST_CHECK(ret.first->second == mapExpected.begin()->second);
+    BOOST_CHECK_EQUAL(map.size(), vIndex.size());
+
+    for (std::map<uint256, CBlockIndex*>::const_iterator it = mapExpected.begin(); it != mapExpected.end(); ++it) {
+        BlockMap::const_iterator mi = map.find(it->first);
+        BOOST_CHECK(mi != map.end() && mi->second == it->second);
+        BOOST_CHECK_EQUAL(map.count(it->first), 1U);
+        BOOST_CHECK(map[it->first] == it->second);
+    }
+    BOOST_CHECK(map.find(GetRandHash()) == map.end());
+
+    // Iteration visits every entry once
+    size_t nCount = 0;
+    for (BlockMap::const_iterator it = map.begin(); it != map.end(); ++it) {
+        BOOST_CHECK(mapExpected.count(it->first) && mapExpected[it->first] == it->second);
+        nCount++;
+    }
+    BOOST_CHECK_EQUAL(nCount, vIndex.size());
+
+    // operator[] inserts a null entry
+    uint256 hash = GetRandHash();
+    BOOST_CHECK(map[hash] == NULL);
+    BOOST_CHECK_EQUAL(map.count(hash), 1U);
+    map[hash] = &vIndex[0];
+    BOOST_CHECK(map.find(hash)->second == &vIndex[0]);
+    BOOST_CHECK_EQUAL(map.size(), vIndex.size() + 1);
+
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.begin() == map.end());
+    BOOST_CHECK(map.find(hash) == map.end());
+}
+
+BOOST_AUTO_TEST_CASE(blockindexarena_test)
+{
+    CBlockIndexArena arena;
+    std::vector<uint256> vHash;
+    std::vector<CBlockIndex*> vIndex;
+    CBlockIndex indexTemplate;
+    indexTemplate.nHeight = 7;
+    for (int i = 0; i < 10000; i++) {
+        vHash.push_back(GetRandHash());
+        vIndex.push_back(arena.Allocate(vHash.back(), indexTemplate));
+    }
+    for (size_t i = 0; i < vIndex.size(); i++) {
+        BOOST_CHECK(vIndex[i]->GetBlockHash() == vHash[i]);
+        BOOST_CHECK_EQUAL(vIndex[i]->nHeight, 7);
+    }
+    arena.Clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -545,4 +545,30 @@ BOOST_AUTO_TEST_CASE(rolling_bloom)
     }
 }
 
+BOOST_AUTO_TEST_CASE(txid_filter)
+{
+    // 10 bits per element at capacity
+    CTxidFilter filter(12800);
+    BOOST_CHECK_EQUAL(filter.GetCapacity(), 10240U);
+
+    std::vector<uint256> vTxid;
+    for (int i = 0; i < 10240; i++) {
+        vTxid.push_back(GetRandHash());
+        filter.insert(vTxid.back());
+    }
+    BOOST_CHECK_EQUAL(filter.GetInserted(), 10240U);
+    BOOST_FOREACH(const uint256& txid, vTxid)
+        BOOST_CHECK(filter.contains(txid));
+
+    // Expect about 100 false positives, more than 200 means
+    // something is broken.
+    int nHits = 0;
+    for (int i = 0; i < 10000; i++) {
+        if (filter.contains(GetRandHash()))
+            ++nHits;
+    }
+    BOOST_TEST_MESSAGE("CTxidFilter got " << nHits << " false positives (~100 expected)");
+    BOOST_CHECK(nHits < 200);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
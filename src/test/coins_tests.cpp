@@ -9,6 +9,7 @@
 #include "utilstrencodings.h"
 #include "test/test_bitcoin.h"
 #include "main.h"
+#include "txdb.h"
 #include "consensus/validation.h"
 
 #include <vector>
@@ -415,4 +416,42 @@ BOOST_AUTO_TEST_CASE(ccoins_serialization)
     }
 }
 
+BOOST_AUTO_TEST_CASE(coinsviewdb_filter)
+{
+    CCoinsViewDB view(1 << 20, true);
+    CCoins coins;
+    coins.nVersion = 1;
+    coins.vout.resize(1);
+    coins.vout[0].nValue = 1;
+
+    // Written before the filter is built, so found by the scan
+    uint256 txid1 = GetRandHash();
+    {
+        CCoinsViewCache cache(&view);
+        *cache.ModifyCoins(txid1) = coins;
+        BOOST_CHECK(cache.Flush());
+    }
+    view.SetFilterSize(1 << 16);
+    view.WaitForFilter();
+
+    // Written afterwards, so added by BatchWrite
+    uint256 txid2 = GetRandHash();
+    {
+        CCoinsViewCache cache(&view);
+        *cache.ModifyCoins(txid2) = coins;
+        BOOST_CHECK(cache.Flush());
+    }
+
+    CCoins coinsOut;
+    BOOST_CHECK(view.HaveCoins(txid1));
+    BOOST_CHECK(view.GetCoins(txid2, coinsOut));
+    BOOST_CHECK(coinsOut == coins);
+    BOOST_CHECK(!view.HaveCoins(GetRandHash()));
+
+    // Without a filter everything goes to the database
+    view.SetFilterSize(0);
+    BOOST_CHECK(view.HaveCoins(txid1));
+    BOOST_CHECK(view.HaveCoins(txid2));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -7,6 +7,7 @@
 #include "random.h"
 #include "test/test_bitcoin.h"
 
+#include <boost/foreach.hpp>
 #include <boost/assign/std/vector.hpp> // for 'operator+=()'
 #include <boost/assert.hpp>
 #include <boost/test/unit_test.hpp>
@@ -203,5 +204,95 @@ BOOST_AUTO_TEST_CASE(existing_data_reindex)
     BOOST_CHECK(odbw.Read(key, res3));
     BOOST_CHECK_EQUAL(res3.ToString(), in2.ToString());
 }
- 
+
+BOOST_AUTO_TEST_CASE(dbwrapper_async)
+{
+    // Perform tests both obfuscated and non-obfuscated.
+    for (int i = 0; i < 2; i++) {
+        bool obfuscate = (bool)i;
+        path ph = temp_directory_path() / unique_path();
+        CDBWrapper dbw(ph, (1 << 20), true, false, obfuscate);
+
+        uint256 in = GetRandHash(), in2 = GetRandHash();
+        uint256 res;
+        BOOST_CHECK(dbw.Write('e', in));
+
+        // Reads see a batch written in the background right away
+        for (int j = 0; j < 10; j++) {
+            CDBBatch batch(dbw);
+            batch.Write(std::make_pair('k', j), in);
+            batch.Write(std::make_pair('k', j), in2);
+            batch.Write(std::make_pair('k', j + 10), in);
+            batch.Erase(std::make_pair('k', j + 10));
+            batch.Erase('e');
+            dbw.WriteBatchAsync(batch);
+            BOOST_CHECK(dbw.Read(std::make_pair('k', j), res));
+            BOOST_CHECK(res == in2);
+            BOOST_CHECK(!dbw.Exists(std::make_pair('k', j + 10)));
+            BOOST_CHECK(!dbw.Exists('e'));
+        }
+        dbw.WaitForWrites();
+        for (int j = 0; j < 10; j++) {
+            BOOST_CHECK(dbw.Read(std::make_pair('k', j), res));
+            BOOST_CHECK(res == in2);
+        }
+
+        // Iterators wait for the write
+        CDBBatch batch(dbw);
+        batch.Write(std::make_pair('k', 20), in);
+        dbw.WriteBatchAsync(batch);
+        boost::scoped_ptr<CDBIterator> it(dbw.NewIterator());
+        it->Seek(std::make_pair('k', 20));
+        std::pair<char, int> key;
+        BOOST_CHECK(it->Valid() && it->GetKey(key) && key == std::make_pair('k', 20));
+        BOOST_CHECK(it->GetValue(res) && res == in);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(dbwrapper_tuning)
+{
+    CDBTuning tuning(1 << 20);
+    BOOST_CHECK_EQUAL(tuning.nBlockCache, 1U << 19);
+    BOOST_CHECK_EQUAL(tuning.nWriteBuffer, 1U << 18);
+    BOOST_CHECK_EQUAL(tuning.nBloomBits, 10);
+
+    mapArgs["-testdbwritebuffer"] = "3";
+    mapArgs["-testdbbloombits"] = "0";
+    tuning = GetDBTuning("test", 8 << 20);
+    mapArgs.erase("-testdbwritebuffer");
+    mapArgs.erase("-testdbbloombits");
+    BOOST_CHECK_EQUAL(tuning.nBlockCache, 4U << 20);
+    BOOST_CHECK_EQUAL(tuning.nWriteBuffer, 3U << 20);
+    BOOST_CHECK_EQUAL(tuning.nBloomBits, 0);
+}
+
+BOOST_AUTO_TEST_CASE(dbwrapper_stats)
+{
+    path ph = temp_directory_path() / unique_path();
+    CDBTuning tuning(1 << 20);
+    tuning.nWriteBuffer = 64 << 10;
+    tuning.nBloomBits = 0;
+    CDBWrapper dbw(ph, tuning, true);
+    BOOST_CHECK_EQUAL(dbw.GetTuning().nWriteBuffer, 64U << 10);
+
+    // Writes wait for all but the latest full write buffer to be written
+    // out, so several buffers' worth leaves tables on disk.
+    for (int i = 0; i < 1000; i++) {
+        CDBBatch batch(dbw);
+        for (int j = 0; j < 10; j++)
+            batch.Write(std::make_pair('k', GetRandHash()), std::vector<unsigned char>(100, 'v'));
+        BOOST_CHECK(dbw.WriteBatch(batch));
+    }
+
+    CDBStats stats;
+    dbw.GetStats(stats);
+    BOOST_CHECK(stats.nApproximateSize > 0);
+    BOOST_CHECK(!stats.vLevels.empty());
+    BOOST_CHECK(stats.strStats.find("Compactions") != std::string::npos);
+    int nFiles = 0;
+    BOOST_FOREACH(const CDBLevelStats& level, stats.vLevels)
+        nFiles += level.nFiles;
+    BOOST_CHECK(nFiles > 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,86 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "flatset.h"
+#include "random.h"
+
+#include "test/test_bitcoin.h"
+
+#include <set>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(flatset_tests, BasicTestingSetup)
+
+static void CheckEqual(const flatset<int>& fs, const std::set<int>& s)
+{
+    BOOST_CHECK_EQUAL(fs.size(), s.size());
+    BOOST_CHECK_EQUAL(fs.empty(), s.empty());
+    BOOST_CHECK(std::equal(s.begin(), s.end(), fs.begin()));
+}
+
+BOOST_AUTO_TEST_CASE(flatset_basic)
+{
+    flatset<int> fs;
+    BOOST_CHECK(fs.empty());
+    BOOST_CHECK(fs.find(1) == fs.end());
+
+    BOOST_CHECK(fs.insert(3).second);
+    BOOST_CHECK(fs.insert(1).second);
+    BOOST_CHECK(fs.insert(2).second);
+    BOOST_CHECK(!fs.insert(2).second);
+    BOOST_CHECK_EQUAL(fs.size(), 3U);
+    BOOST_CHECK_EQUAL(*fs.begin(), 1);
+    BOOST_CHECK_EQUAL(*fs.find(2), 2);
+    BOOST_CHECK_EQUAL(fs.count(3), 1U);
+    BOOST_CHECK_EQUAL(fs.count(4), 0U);
+
+    // Range insert of unsorted input with duplicates
+    int vals[] = {5, 2, 4, 5, 0};
+    fs.insert(vals, vals + 5);
+    std::set<int> s(vals, vals + 5);
+    s.insert(1);
+    s.insert(3);
+    CheckEqual(fs, s);
+
+    BOOST_CHECK_EQUAL(fs.erase(4), 1U);
+    BOOST_CHECK_EQUAL(fs.erase(4), 0U);
+    fs.erase(fs.find(0));
+    s.erase(4);
+    s.erase(0);
+    CheckEqual(fs, s);
+
+    flatset<int> fs2(s.begin(), s.end());
+    BOOST_CHECK(fs == fs2);
+    fs2.clear();
+    BOOST_CHECK(fs != fs2);
+}
+
+BOOST_AUTO_TEST_CASE(flatset_random)
+{
+    flatset<int> fs;
+    std::set<int> s;
+    for (int i = 0; i < 1000; i++) {
+        int r = insecure_rand() % 4;
+        int x = insecure_rand() % 200;
+        if (r == 0) {
+            BOOST_CHECK_EQUAL(fs.insert(x).second, s.insert(x).second);
+        } else if (r == 1) {
+            BOOST_CHECK_EQUAL(fs.erase(x), s.erase(x));
+        } else if (r == 2) {
+            std::vector<int> v;
+            for (int j = insecure_rand() % 8; j > 0; j--) {
+                v.push_back(insecure_rand() % 200);
+            }
+            fs.insert(v.begin(), v.end());
+            s.insert(v.begin(), v.end());
+        } else {
+            BOOST_CHECK_EQUAL(fs.count(x), s.count(x));
+        }
+        CheckEqual(fs, s);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,8 +2,11 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "blockcache.h"
 #include "chainparams.h"
+#include "clientversion.h"
 #include "main.h"
+#include "streams.h"
 
 #include "test/test_bitcoin.h"
 
@@ -72,4 +75,30 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+BOOST_FIXTURE_TEST_CASE(read_raw_block, TestChain100Setup)
+{
+    LOCK(cs_main);
+    const CChainParams& chainparams = Params();
+    // Make sure the blocks come from disk rather than the recent block cache.
+    blockcache.Clear();
+    for (CBlockIndex* pindex = chainActive.Tip(); pindex; pindex = pindex->pprev) {
+        CBlock block;
+        BOOST_CHECK(ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()));
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << block;
+
+        std::vector<unsigned char> vchBlock;
+        BOOST_CHECK(ReadRawBlockFromDisk(vchBlock, pindex, chainparams.MessageStart()));
+        BOOST_CHECK(std::vector<unsigned char>(ss.begin(), ss.end()) == vchBlock);
+    }
+
+    // A position that doesn't point right behind a block header is rejected.
+    std::vector<unsigned char> vchBlock;
+    CDiskBlockPos pos = chainActive.Tip()->GetBlockPos();
+    pos.nPos += 1;
+    BOOST_CHECK(!ReadRawBlockFromDisk(vchBlock, pos, chainparams.MessageStart()));
+    pos.nPos = 0;
+    BOOST_CHECK(!ReadRawBlockFromDisk(vchBlock, pos, chainparams.MessageStart()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -2,7 +2,9 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "clientversion.h"
 #include "txmempool.h"
+#include "txmempooloverflow.h"
 #include "util.h"
 
 #include "test/test_bitcoin.h"
@@ -410,8 +412,8 @@ BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
     CheckSort<ancestor_score>(pool, sortedOrder);
 
     /* after tx6 is mined, tx7 should move up in the sort */
-    std::vector<CTransaction> vtx;
-    vtx.push_back(tx6);
+    std::vector<CTransactionRef> vtx;
+    vtx.push_back(MakeTransactionRef(tx6));
     std::list<CTransaction> dummy;
     pool.removeForBlock(vtx, 1, dummy, false);
 
@@ -547,7 +549,7 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     pool.addUnchecked(tx5.GetHash(), entry.Fee(1000LL).FromTx(tx5, &pool));
     pool.addUnchecked(tx7.GetHash(), entry.Fee(9000LL).FromTx(tx7, &pool));
 
-    std::vector<CTransaction> vtx;
+    std::vector<CTransactionRef> vtx;
     std::list<CTransaction> conflicts;
     SetMockTime(42);
     SetMockTime(42 + CTxMemPool::ROLLING_FEE_HALFLIFE);
@@ -577,4 +579,191 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(DisconnectedBlockTransactionsTest)
+{
+    // Two "blocks" worth of a chain of transactions: tx[0] -> ... -> tx[5]
+    std::vector<CTransactionRef> vtx;
+    uint256 hashPrev;
+    for (int i = 0; i < 6; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(hashPrev, 0);
+        tx.vin[0].scriptSig = CScript() << OP_11;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[0].nValue = 10 * COIN;
+        vtx.push_back(MakeTransactionRef(tx));
+        hashPrev = vtx.back()->GetHash();
+    }
+    std::vector<CTransactionRef> vBlock1(vtx.begin(), vtx.begin() + 3);
+    std::vector<CTransactionRef> vBlock2(vtx.begin() + 3, vtx.end());
+
+    // Disconnect the later block first, adding each block's transactions
+    // in reverse, as DisconnectTip does.
+    DisconnectedBlockTransactions disconnectpool;
+    BOOST_CHECK_EQUAL(disconnectpool.DynamicMemoryUsage(), 0U);
+    BOOST_REVERSE_FOREACH(const CTransactionRef& tx, vBlock2)
+        disconnectpool.addTransaction(tx);
+    BOOST_REVERSE_FOREACH(const CTransactionRef& tx, vBlock1)
+        disconnectpool.addTransaction(tx);
+    BOOST_CHECK_EQUAL(disconnectpool.queuedTx.size(), 6U);
+    size_t nUsage = disconnectpool.DynamicMemoryUsage();
+    BOOST_CHECK(nUsage > 0);
+
+    // Adding a duplicate doesn't change anything
+    disconnectpool.addTransaction(MakeTransactionRef(*vtx[0]));
+    BOOST_CHECK_EQUAL(disconnectpool.queuedTx.size(), 6U);
+    BOOST_CHECK_EQUAL(disconnectpool.DynamicMemoryUsage(), nUsage);
+
+    // Walking insertion order backwards yields the transactions in chain order
+    int i = 0;
+    DisconnectedBlockTransactions::indexed_disconnected_transactions::index<insertion_order>::type::reverse_iterator rit;
+    for (rit = disconnectpool.queuedTx.get<insertion_order>().rbegin(); rit != disconnectpool.queuedTx.get<insertion_order>().rend(); ++rit)
+        BOOST_CHECK((*rit)->GetHash() == vtx[i++]->GetHash());
+
+    // Re-confirming the first block removes its transactions only
+    disconnectpool.removeForBlock(vBlock1);
+    BOOST_CHECK_EQUAL(disconnectpool.queuedTx.size(), 3U);
+    BOOST_CHECK(disconnectpool.DynamicMemoryUsage() < nUsage);
+    BOOST_CHECK(disconnectpool.queuedTx.count(vtx[0]->GetHash()) == 0);
+    BOOST_CHECK(disconnectpool.queuedTx.count(vtx[3]->GetHash()) == 1);
+
+    // Dropping the earliest entry removes the last transaction of the tip block
+    disconnectpool.removeEntry(disconnectpool.queuedTx.get<insertion_order>().begin());
+    BOOST_CHECK_EQUAL(disconnectpool.queuedTx.size(), 2U);
+    BOOST_CHECK(disconnectpool.queuedTx.count(vtx[5]->GetHash()) == 0);
+
+    disconnectpool.clear();
+    BOOST_CHECK(disconnectpool.queuedTx.empty());
+    BOOST_CHECK_EQUAL(disconnectpool.DynamicMemoryUsage(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolOverflowTest)
+{
+    CTxMemPool pool(CFeeRate(1000));
+    TestMemPoolEntryHelper entry;
+    CTxMemPoolOverflow overflow;
+    boost::filesystem::path path = pathTemp / "mempool_overflow.dat";
+    BOOST_CHECK(overflow.Open(path, 1000000));
+
+    // tx1 is a low-fee parent paid for by its child tx2, tx3 stands alone
+    CMutableTransaction tx1, tx2, tx3;
+    tx1.vin.resize(1);
+    tx1.vin[0].scriptSig = CScript() << OP_1;
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx1.GetHash(), entry.Fee(1000LL).Time(1).FromTx(tx1, &pool));
+    tx2 = tx1;
+    tx2.vin[0].prevout = COutPoint(tx1.GetHash(), 0);
+    pool.addUnchecked(tx2.GetHash(), entry.Fee(3000LL).Time(2).FromTx(tx2, &pool));
+    tx3 = tx1;
+    tx3.vin[0].scriptSig = CScript() << OP_3;
+    pool.addUnchecked(tx3.GetHash(), entry.Fee(10000LL).Time(3).FromTx(tx3, &pool));
+
+    pool.TrimToSize(0, NULL, &overflow);
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+    BOOST_CHECK_EQUAL(overflow.size(), 3U);
+    BOOST_CHECK(overflow.GetDiskUsage() > 0);
+    BOOST_CHECK(overflow.DynamicMemoryUsage() > 0);
+
+    // Nothing below the requested feerate is handed back
+    CTransactionRef tx;
+    BOOST_CHECK(!overflow.PopBest(CFeeRate(1000000), tx));
+    BOOST_CHECK_EQUAL(overflow.size(), 3U);
+
+    // Best package feerate first, and parents before their children
+    BOOST_CHECK(overflow.PopBest(CFeeRate(0), tx));
+    BOOST_CHECK(tx->GetHash() == tx3.GetHash());
+    BOOST_CHECK(overflow.PopBest(CFeeRate(0), tx));
+    BOOST_CHECK(tx->GetHash() == tx1.GetHash());
+    BOOST_CHECK_EQUAL(overflow.size(), 1U);
+
+    // Mined transactions are forgotten
+    std::vector<CTransactionRef> vBlock(1, MakeTransactionRef(tx2));
+    overflow.RemoveForBlock(vBlock);
+    BOOST_CHECK_EQUAL(overflow.size(), 0U);
+    BOOST_CHECK(!overflow.PopBest(CFeeRate(0), tx));
+
+    // Expiry goes by the time the transaction first entered the mempool
+    overflow.Add(tx1, CFeeRate(1000), 1);
+    overflow.Add(tx3, CFeeRate(2000), 3);
+    BOOST_CHECK_EQUAL(overflow.Expire(2), 1U);
+    BOOST_CHECK(overflow.PopBest(CFeeRate(0), tx));
+    BOOST_CHECK(tx->GetHash() == tx3.GetHash());
+
+    // Over the disk limit, the lowest feerate transactions are dropped
+    BOOST_CHECK(overflow.Open(path, ::GetSerializeSize(CTransaction(tx1), SER_DISK, CLIENT_VERSION) + 1));
+    overflow.Add(tx1, CFeeRate(1000), 1);
+    overflow.Add(tx3, CFeeRate(2000), 3);
+    BOOST_CHECK_EQUAL(overflow.size(), 1U);
+    BOOST_CHECK(overflow.PopBest(CFeeRate(0), tx));
+    BOOST_CHECK(tx->GetHash() == tx3.GetHash());
+
+    overflow.Add(tx1, CFeeRate(1000), 1);
+    overflow.Clear();
+    BOOST_CHECK_EQUAL(overflow.size(), 0U);
+    BOOST_CHECK_EQUAL(overflow.GetDiskUsage(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolJournalTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    std::vector<CTxMemPoolChange> vChanges;
+    BOOST_CHECK_EQUAL(pool.GetSequence(), 0U);
+    BOOST_CHECK(pool.GetChangesSince(0, vChanges));
+    BOOST_CHECK(vChanges.empty());
+
+    CMutableTransaction tx1, tx2;
+    tx1.vin.resize(1);
+    tx1.vin[0].scriptSig = CScript() << OP_1;
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    tx2 = tx1;
+    tx2.vin[0].prevout = COutPoint(tx1.GetHash(), 0);
+    pool.addUnchecked(tx1.GetHash(), entry.FromTx(tx1, &pool));
+    pool.addUnchecked(tx2.GetHash(), entry.FromTx(tx2, &pool));
+    std::list<CTransaction> removed;
+    pool.removeRecursive(tx1, removed, MemPoolRemovalReason::CONFLICT);
+    BOOST_CHECK_EQUAL(pool.GetSequence(), 4U);
+
+    BOOST_CHECK(pool.GetChangesSince(1, vChanges));
+    BOOST_CHECK_EQUAL(vChanges.size(), 3U);
+    BOOST_CHECK_EQUAL(vChanges[0].nSequence, 2U);
+    BOOST_CHECK(vChanges[0].fAdded);
+    BOOST_CHECK(vChanges[0].txid == tx2.GetHash());
+    for (unsigned int i = 1; i < 3; i++) {
+        BOOST_CHECK_EQUAL(vChanges[i].nSequence, i + 2);
+        BOOST_CHECK(!vChanges[i].fAdded);
+        BOOST_CHECK(vChanges[i].reason == MemPoolRemovalReason::CONFLICT);
+    }
+    vChanges.clear();
+    BOOST_CHECK(pool.GetChangesSince(4, vChanges));
+    BOOST_CHECK(vChanges.empty());
+    BOOST_CHECK(!pool.GetChangesSince(5, vChanges));
+
+    // Once changes fall out of the journal, callers have to resync
+    for (unsigned int i = 0; i < MEMPOOL_JOURNAL_SIZE / 2; i++) {
+        pool.addUnchecked(tx1.GetHash(), entry.FromTx(tx1, &pool));
+        pool.removeRecursive(tx1, removed);
+    }
+    uint64_t nSequence = pool.GetSequence();
+    BOOST_CHECK_EQUAL(nSequence, 4U + MEMPOOL_JOURNAL_SIZE);
+    BOOST_CHECK(!pool.GetChangesSince(0, vChanges));
+    BOOST_CHECK(!pool.GetChangesSince(nSequence - MEMPOOL_JOURNAL_SIZE - 1, vChanges));
+    BOOST_CHECK(vChanges.empty());
+    BOOST_CHECK(pool.GetChangesSince(nSequence - MEMPOOL_JOURNAL_SIZE, vChanges));
+    BOOST_CHECK_EQUAL(vChanges.size(), MEMPOOL_JOURNAL_SIZE);
+    BOOST_CHECK_EQUAL(vChanges.back().nSequence, nSequence);
+
+    // Clearing the mempool keeps the sequence number, but not the journal
+    pool.clear();
+    vChanges.clear();
+    BOOST_CHECK_EQUAL(pool.GetSequence(), nSequence);
+    BOOST_CHECK(pool.GetChangesSince(nSequence, vChanges));
+    BOOST_CHECK(!pool.GetChangesSince(nSequence - 1, vChanges));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -152,6 +152,9 @@ void DoTest(const CScript& scriptPubKey, const CScript& scriptSig, int flags, co
     CMutableTransaction tx2 = tx;
     BOOST_CHECK_MESSAGE(VerifyScript(scriptSig, scriptPubKey, flags, MutableTransactionSignatureChecker(&tx, 0), &err) == expect, message);
     BOOST_CHECK_MESSAGE(err == scriptError, std::string(FormatScriptError(err)) + " where " + std::string(FormatScriptError((ScriptError_t)scriptError)) + " expected: " + message);
+    // The shortcut for standard scripts must not accept anything the interpreter doesn't
+    if (VerifyStandardScript(scriptSig, scriptPubKey, flags, MutableTransactionSignatureChecker(&tx, 0)))
+        BOOST_CHECK_MESSAGE(expect, "VerifyStandardScript: " + message);
 #if defined(HAVE_CONSENSUS_LIB)
     CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
     stream << tx2;
@@ -798,9 +801,11 @@ BOOST_AUTO_TEST_CASE(script_CHECKMULTISIG12)
     CScript goodsig1 = sign_multisig(scriptPubKey12, key1, txTo12);
     BOOST_CHECK(VerifyScript(goodsig1, scriptPubKey12, flags, MutableTransactionSignatureChecker(&txTo12, 0), &err));
     BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_OK, ScriptErrorString(err));
+    BOOST_CHECK(VerifyStandardScript(goodsig1, scriptPubKey12, flags, MutableTransactionSignatureChecker(&txTo12, 0)));
     txTo12.vout[0].nValue = 2;
     BOOST_CHECK(!VerifyScript(goodsig1, scriptPubKey12, flags, MutableTransactionSignatureChecker(&txTo12, 0), &err));
     BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_EVAL_FALSE, ScriptErrorString(err));
+    BOOST_CHECK(!VerifyStandardScript(goodsig1, scriptPubKey12, flags, MutableTransactionSignatureChecker(&txTo12, 0)));
 
     CScript goodsig2 = sign_multisig(scriptPubKey12, key2, txTo12);
     BOOST_CHECK(VerifyScript(goodsig2, scriptPubKey12, flags, MutableTransactionSignatureChecker(&txTo12, 0), &err));
@@ -843,6 +848,7 @@ BOOST_AUTO_TEST_CASE(script_CHECKMULTISIG23)
     CScript goodsig3 = sign_multisig(scriptPubKey23, keys, txTo23);
     BOOST_CHECK(VerifyScript(goodsig3, scriptPubKey23, flags, MutableTransactionSignatureChecker(&txTo23, 0), &err));
     BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_OK, ScriptErrorString(err));
+    BOOST_CHECK(VerifyStandardScript(goodsig3, scriptPubKey23, flags, MutableTransactionSignatureChecker(&txTo23, 0)));
 
     keys.clear();
     keys.push_back(key2); keys.push_back(key2); // Can't re-use sig
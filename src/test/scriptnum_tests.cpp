@@ -34,6 +34,12 @@ static void CheckCreateVch(const int64_t& num)
     CScriptNum scriptnum2(scriptnum.getvch(), false);
     BOOST_CHECK(verify(bignum2, scriptnum2));
 
+    // The same encoding on the script stack
+    CScriptStackValue value;
+    scriptnum.getvch(value);
+    BOOST_CHECK(std::vector<unsigned char>(value.begin(), value.end()) == vch);
+    BOOST_CHECK(verify(bignum2, CScriptNum(value, false)));
+
     CScriptNum10 bignum3(scriptnum2.getvch(), false);
     CScriptNum scriptnum3(bignum2.getvch(), false);
     BOOST_CHECK(verify(bignum3, scriptnum3));
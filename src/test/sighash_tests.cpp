@@ -166,6 +166,27 @@ BOOST_AUTO_TEST_CASE(sighash_test)
     #endif
 }
 
+BOOST_AUTO_TEST_CASE(sighash_precomputed)
+{
+    seed_insecure_rand(false);
+
+    // Every input, of transactions with up to 200 inputs
+    for (int i = 0; i < 200; i++) {
+        CMutableTransaction txTo;
+        RandomTransaction(txTo, false);
+        while (txTo.vin.size() <= (unsigned int)i)
+            txTo.vin.push_back(txTo.vin[insecure_rand() % txTo.vin.size()]);
+        const CTransaction tx(txTo);
+        PrecomputedTransactionData txdata(tx);
+        for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++) {
+            int nHashType = (insecure_rand() % 2) ? SIGHASH_ALL : insecure_rand();
+            CScript scriptCode;
+            RandomScript(scriptCode);
+            BOOST_CHECK(SignatureHash(scriptCode, tx, nIn, nHashType, &txdata) == SignatureHashOld(scriptCode, tx, nIn, nHashType));
+        }
+    }
+}
+
 // Goal: check that SignatureHash generates correct hash
 BOOST_AUTO_TEST_CASE(sighash_from_data)
 {
@@ -211,6 +232,9 @@ BOOST_AUTO_TEST_CASE(sighash_from_data)
 
         sh = SignatureHash(scriptCode, tx, nIn, nHashType);
         BOOST_CHECK_MESSAGE(sh.GetHex() == sigHashHex, strTest);
+        PrecomputedTransactionData txdata(tx);
+        sh = SignatureHash(scriptCode, tx, nIn, nHashType, &txdata);
+        BOOST_CHECK_MESSAGE(sh.GetHex() == sigHashHex, strTest);
     }
 }
 BOOST_AUTO_TEST_SUITE_END()
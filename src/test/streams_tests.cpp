@@ -64,4 +64,26 @@ BOOST_AUTO_TEST_CASE(streams_serializedata_xor)
             std::string(ds.begin(), ds.end()));  
 }         
 
+BOOST_AUTO_TEST_CASE(streams_pooled_getandclear)
+{
+    CPooledDataStream ss(0, 0);
+    ss << (uint32_t)0x01020304 << std::string("abc");
+    const char* pData = &ss[0];
+
+    // Into an empty vector the buffer is handed over, not copied...
+    CPooledSerializeData data;
+    ss.GetAndClear(data);
+    BOOST_CHECK(ss.empty());
+    BOOST_CHECK_EQUAL(data.size(), 8U);
+    BOOST_CHECK(&data[0] == pData);
+
+    // ... otherwise appended
+    ss << (uint8_t)5;
+    ss.GetAndClear(data);
+    BOOST_CHECK(ss.empty());
+    BOOST_CHECK_EQUAL(data.size(), 9U);
+    BOOST_CHECK_EQUAL(data[0], 4);
+    BOOST_CHECK_EQUAL(data[8], 5);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -404,4 +404,79 @@ BOOST_AUTO_TEST_CASE(test_IsStandard)
     BOOST_CHECK(!IsStandardTx(t, reason));
 }
 
+BOOST_AUTO_TEST_CASE(test_TransactionRef)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].scriptSig = CScript() << OP_1;
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 90*CENT;
+    mtx.vout[0].scriptPubKey = CScript() << OP_1;
+
+    // A reference serializes exactly as the transaction it points to
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(mtx));
+    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION), ssRef(SER_NETWORK, PROTOCOL_VERSION);
+    ssTx << CTransaction(mtx);
+    ssRef << block.vtx[0];
+    BOOST_CHECK(ssTx.str() == ssRef.str());
+    BOOST_CHECK_EQUAL(::GetSerializeSize(block.vtx[0], SER_NETWORK, PROTOCOL_VERSION), ssTx.size());
+
+    // Copies of a block share its transactions...
+    CBlock blockCopy(block);
+    BOOST_CHECK(blockCopy.vtx[0] == block.vtx[0]);
+    BOOST_CHECK_EQUAL(block.vtx[0].use_count(), 2);
+
+    // ... while deserializing creates a new one, with the same hash
+    CTransactionRef tx;
+    ssRef >> tx;
+    BOOST_CHECK(tx != block.vtx[0]);
+    BOOST_CHECK(tx->GetHash() == mtx.GetHash());
+}
+
+template <typename T>
+static unsigned int StreamSize(const T& obj)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << obj;
+    return ss.size();
+}
+
+BOOST_AUTO_TEST_CASE(test_SerializeSize)
+{
+    // The directly computed (and for CTransaction cached) sizes match what is written
+    BOOST_CHECK_EQUAL(::GetSerializeSize(CTransaction(), SER_NETWORK, PROTOCOL_VERSION), StreamSize(CTransaction()));
+
+    CMutableTransaction mtx;
+    mtx.vin.resize(2);
+    mtx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 2) << std::vector<unsigned char>(33, 3);
+    mtx.vin[1].scriptSig = CScript() << std::vector<unsigned char>(300, 4);
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 90*CENT;
+    mtx.vout[0].scriptPubKey = CScript() << OP_1;
+    BOOST_CHECK_EQUAL(mtx.vin[1].scriptSig.GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION), 3U + 303U);
+    BOOST_CHECK_EQUAL(::GetSerializeSize(mtx.vin[0], SER_NETWORK, PROTOCOL_VERSION), StreamSize(mtx.vin[0]));
+    BOOST_CHECK_EQUAL(::GetSerializeSize(mtx.vout[0], SER_NETWORK, PROTOCOL_VERSION), StreamSize(mtx.vout[0]));
+    BOOST_CHECK_EQUAL(::GetSerializeSize(mtx, SER_NETWORK, PROTOCOL_VERSION), StreamSize(mtx));
+
+    const CTransaction tx(mtx);
+    BOOST_CHECK_EQUAL(::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION), StreamSize(tx));
+
+    // Deserialization and assignment update the cached size
+    CTransaction txCopy;
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << tx;
+    ss >> txCopy;
+    BOOST_CHECK_EQUAL(::GetSerializeSize(txCopy, SER_DISK, CLIENT_VERSION), StreamSize(tx));
+    txCopy = CTransaction();
+    BOOST_CHECK_EQUAL(::GetSerializeSize(txCopy, SER_DISK, CLIENT_VERSION), StreamSize(CTransaction()));
+
+    CBlock block;
+    BOOST_CHECK_EQUAL(::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION), StreamSize(block));
+    block.vtx.push_back(MakeTransactionRef(tx));
+    block.vtx.push_back(MakeTransactionRef(mtx));
+    BOOST_CHECK_EQUAL(::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION), StreamSize(block));
+    BOOST_CHECK_EQUAL(::GetSerializeSize(block.GetBlockHeader(), SER_NETWORK, PROTOCOL_VERSION), 80U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
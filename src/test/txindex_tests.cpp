@@ -0,0 +1,69 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "main.h"
+#include "script/standard.h"
+#include "test/test_bitcoin.h"
+#include "txindex.h"
+#include "utiltime.h"
+#include "validationinterface.h"
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txindex_tests, TestChain100Setup)
+
+static bool WaitForSync(const CTxIndex& txindex)
+{
+    for (int i = 0; i < 1000; i++) {
+        {
+            LOCK(cs_main);
+            if (txindex.IsSynced())
+                return true;
+        }
+        MilliSleep(10);
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(txindex_sync)
+{
+    CTxIndex txindex(1 << 20, true);
+    BOOST_CHECK(txindex.Init());
+    CDiskTxPos pos;
+    BOOST_CHECK(!txindex.FindTx(coinbaseTxns[0].GetHash(), pos));
+
+    RegisterValidationInterface(&txindex);
+    boost::thread thread(boost::bind(&CTxIndex::Thread, &txindex));
+
+    // Catch up with the existing chain
+    BOOST_CHECK(WaitForSync(txindex));
+    BOOST_FOREACH(const CTransaction& tx, coinbaseTxns)
+        BOOST_CHECK(txindex.FindTx(tx.GetHash(), pos));
+
+    // Follow new blocks
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CBlock block = CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+    BOOST_CHECK(WaitForSync(txindex));
+
+    // GetTransaction finds confirmed transactions through the index
+    ptxindex = &txindex;
+    CTransaction tx;
+    uint256 hashBlock;
+    BOOST_CHECK(GetTransaction(block.vtx[0]->GetHash(), tx, Params().GetConsensus(), hashBlock, false));
+    BOOST_CHECK(tx == *block.vtx[0]);
+    BOOST_CHECK(hashBlock == block.GetHash());
+    BOOST_CHECK(GetTransaction(coinbaseTxns[0].GetHash(), tx, Params().GetConsensus(), hashBlock, false));
+    BOOST_CHECK(tx == coinbaseTxns[0]);
+    ptxindex = NULL;
+
+    thread.interrupt();
+    thread.join();
+    UnregisterValidationInterface(&txindex);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
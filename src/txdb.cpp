@@ -5,13 +5,17 @@
 
 #include "txdb.h"
 
+#include "bloom.h"
 #include "chainparams.h"
+#include "crypto/common.h"
 #include "hash.h"
 #include "pow.h"
 #include "uint256.h"
 
 #include <stdint.h>
 
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -25,17 +29,38 @@ static const char DB_BEST_BLOCK = 'B';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_INDEX_FILE = 'i';
+static const char DB_ADDRINDEX = 'a';
+static const char DB_ADDRINDEX_HEIGHT = 'h';
 
+/** Stale records the flat block index file may hold before it is rewritten */
+static const uint64_t INDEX_FILE_MAX_STALE = 10000;
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
+
+CCoinsViewDB::CCoinsViewDB(const CDBTuning& tuning, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", tuning, fMemory, fWipe, true),
+    nFilterBytes(0), nFilterRebuildAt(0)
+{
+}
+
+CCoinsViewDB::~CCoinsViewDB()
 {
+    StopFilterBuild();
+}
+
+bool CCoinsViewDB::MayHaveCoins(const uint256 &txid) const {
+    LOCK(cs_filter);
+    return !pfilter || pfilter->contains(txid);
 }
 
 bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
+    if (!MayHaveCoins(txid))
+        return false;
     return db.Read(make_pair(DB_COINS, txid), coins);
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
+    if (!MayHaveCoins(txid))
+        return false;
     return db.Exists(make_pair(DB_COINS, txid));
 }
 
@@ -50,26 +75,135 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
-        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            if (it->second.coins.IsPruned())
-                batch.Erase(make_pair(DB_COINS, it->first));
-            else
-                batch.Write(make_pair(DB_COINS, it->first), it->second.coins);
-            changed++;
+    bool fRebuildFilter = false;
+    {
+        // Add txids to the filters before they can be read from the database.
+        LOCK(cs_filter);
+        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+            if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+                if (it->second.coins.IsPruned()) {
+                    batch.Erase(make_pair(DB_COINS, it->first));
+                } else {
+                    batch.Write(make_pair(DB_COINS, it->first), it->second.coins);
+                    if (pfilter)
+                        pfilter->insert(it->first);
+                    if (pfilterNext)
+                        pfilterNext->insert(it->first);
+                }
+                changed++;
+            }
+            count++;
+            CCoinsMap::iterator itOld = it++;
+            mapCoins.erase(itOld);
         }
-        count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        fRebuildFilter = pfilter && !pfilterNext && pfilter->GetInserted() >= nFilterRebuildAt;
     }
     if (!hashBlock.IsNull())
         batch.Write(DB_BEST_BLOCK, hashBlock);
 
     LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+    db.WriteBatchAsync(batch);
+    if (fRebuildFilter)
+        StartFilterBuild();
+    return true;
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+void CCoinsViewDB::SetFilterSize(size_t nBytes)
+{
+    StopFilterBuild();
+    {
+        LOCK(cs_filter);
+        nFilterBytes = nBytes;
+        pfilter.reset();
+    }
+    if (nBytes > 0)
+        StartFilterBuild();
+}
+
+void CCoinsViewDB::StartFilterBuild()
+{
+    // A finished build only has to be joined.
+    StopFilterBuild();
+    {
+        LOCK(cs_filter);
+        // Catch every txid written from here on, as the scan may not see it.
+        pfilterNext.reset(new CTxidFilter(nFilterBytes));
+    }
+    threadFilter.reset(new boost::thread(boost::bind(&CCoinsViewDB::ThreadBuildFilter, this)));
+}
+
+void CCoinsViewDB::StopFilterBuild()
+{
+    if (threadFilter) {
+        threadFilter->interrupt();
+        threadFilter->join();
+        threadFilter.reset();
+    }
+    LOCK(cs_filter);
+    pfilterNext.reset();
+}
+
+void CCoinsViewDB::WaitForFilter()
+{
+    if (threadFilter) {
+        threadFilter->join();
+        threadFilter.reset();
+    }
+}
+
+void CCoinsViewDB::ThreadBuildFilter()
+{
+    RenameThread("bitcoin-coinsfilter");
+    int64_t nStart = GetTimeMillis();
+    try {
+        // Everything written before pfilterNext was set up is in the
+        // iterator's snapshot, as it waits for pending writes.
+        boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+        pcursor->Seek(DB_COINS);
+        std::vector<uint256> vTxid;
+        bool fDone = false;
+        while (!fDone) {
+            boost::this_thread::interruption_point();
+            vTxid.clear();
+            while (vTxid.size() < 10000) {
+                std::pair<char, uint256> key;
+                if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_COINS) {
+                    fDone = true;
+                    break;
+                }
+                vTxid.push_back(key.second);
+                pcursor->Next();
+            }
+            LOCK(cs_filter);
+            BOOST_FOREACH(const uint256& txid, vTxid)
+                pfilterNext->insert(txid);
+        }
+    } catch (const boost::thread_interrupted&) {
+        throw;
+    } catch (const std::exception& e) {
+        LogPrintf("%s: failed to build the coin database filter: %s\n", __func__, e.what());
+        LOCK(cs_filter);
+        pfilterNext.reset();
+        return;
+    }
+
+    LOCK(cs_filter);
+    pfilter.swap(pfilterNext);
+    pfilterNext.reset();
+    nFilterRebuildAt = std::max(pfilter->GetCapacity(), 2 * pfilter->GetInserted());
+    LogPrintf("Built the coin database filter with %u txids in %dms\n", pfilter->GetInserted(), GetTimeMillis() - nStart);
+}
+
+void CCoinsViewDB::WaitForWrites()
+{
+    db.WaitForWrites();
+}
+
+CBlockTreeDB::CBlockTreeDB(const CDBTuning& tuning, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", tuning, fMemory, fWipe),
+    fUseIndexFile(!fMemory), indexfile(GetDataDir() / "blocks" / "blockindex.dat")
+{
+    if (fUseIndexFile && fWipe)
+        indexfile.Remove();
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -145,18 +279,31 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
         batch.Write(make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
     }
+    // The flat file is synced first, so the marker never covers records
+    // that didn't make it to disk.
+    if (indexfile.IsOpen()) {
+        if (indexfile.Append(blockinfo))
+            batch.Write(DB_INDEX_FILE, make_pair(indexfile.GetNonce(), indexfile.GetSize()));
+        else
+            batch.Erase(DB_INDEX_FILE);
+    }
     return WriteBatch(batch, true);
 }
 
-bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
-    return Read(make_pair(DB_TXINDEX, txid), pos);
+bool CBlockTreeDB::IndexFileNeedsRewrite(size_t nEntries) const
+{
+    return fUseIndexFile && (!indexfile.IsOpen() || indexfile.GetRecordCount() > 2 * nEntries + INDEX_FILE_MAX_STALE);
 }
 
-bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(make_pair(DB_TXINDEX, it->first), it->second);
-    return WriteBatch(batch);
+bool CBlockTreeDB::RewriteIndexFile(const std::vector<const CBlockIndex*>& blockinfo)
+{
+    if (!fUseIndexFile)
+        return false;
+    if (!indexfile.Rewrite(blockinfo)) {
+        Erase(DB_INDEX_FILE, true);
+        return false;
+    }
+    return Write(DB_INDEX_FILE, make_pair(indexfile.GetNonce(), indexfile.GetSize()), true);
 }
 
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
@@ -173,6 +320,12 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
 
 bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex)
 {
+    std::pair<uint64_t, uint64_t> indexFilePos;
+    if (fUseIndexFile && Read(DB_INDEX_FILE, indexFilePos) && indexfile.Load(indexFilePos.first, indexFilePos.second, insertBlockIndex)) {
+        LogPrintf("%s: loaded %u block index records from flat file\n", __func__, indexfile.GetRecordCount());
+        return true;
+    }
+
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
     pcursor->Seek(make_pair(DB_BLOCK_INDEX, uint256()));
@@ -213,3 +366,125 @@ bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256
 
     return true;
 }
+
+/** Path of the database of an optional index, in indexes/ */
+static boost::filesystem::path GetIndexDBPath(const std::string& strName)
+{
+    boost::filesystem::path path = GetDataDir() / "indexes";
+    TryCreateDirectory(path);
+    return path / strName;
+}
+
+CTxIndexDB::CTxIndexDB(const CDBTuning& tuning, bool fMemory, bool fWipe) : CDBWrapper(GetIndexDBPath("txindex"), tuning, fMemory, fWipe)
+{
+}
+
+bool CTxIndexDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) const {
+    return Read(make_pair(DB_TXINDEX, txid), pos);
+}
+
+bool CTxIndexDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Write(make_pair(DB_TXINDEX, it->first), it->second);
+    return WriteBatch(batch);
+}
+
+bool CTxIndexDB::ReadBestBlock(CBlockLocator &locator) const {
+    return Read(DB_BEST_BLOCK, locator);
+}
+
+bool CTxIndexDB::WriteBestBlock(const CBlockLocator &locator) {
+    return Write(DB_BEST_BLOCK, locator);
+}
+
+namespace {
+
+/** Key of the height-ordered listing of a script's outputs; the height is big endian so it sorts. */
+struct CAddrIndexHeightKey
+{
+    char chType;
+    uint256 hashScript;
+    CAddrIndexPos pos;
+
+    CAddrIndexHeightKey() : chType(0) {}
+    CAddrIndexHeightKey(const uint256 &hashScriptIn, const CAddrIndexPos &posIn) :
+        chType(DB_ADDRINDEX_HEIGHT), hashScript(hashScriptIn), pos(posIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        return 1 + 32 + 4 + 36;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream &s, int nType, int nVersion) const {
+        unsigned char chHeight[4];
+        WriteBE32(chHeight, pos.nHeight);
+        s << chType << hashScript;
+        s.write((const char*)chHeight, 4);
+        s << pos.out;
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream &s, int nType, int nVersion) {
+        unsigned char chHeight[4];
+        s >> chType >> hashScript;
+        s.read((char*)chHeight, 4);
+        pos.nHeight = ReadBE32(chHeight);
+        s >> pos.out;
+    }
+};
+
+}
+
+CAddrIndexDB::CAddrIndexDB(const CDBTuning& tuning, bool fMemory, bool fWipe) : CDBWrapper(GetIndexDBPath("addrindex"), tuning, fMemory, fWipe)
+{
+}
+
+bool CAddrIndexDB::ReadEntry(const CAddrIndexKey &key, CAddrIndexEntry &entry) const {
+    return Read(make_pair(DB_ADDRINDEX, key), entry);
+}
+
+bool CAddrIndexDB::WriteEntries(const std::vector<std::pair<CAddrIndexKey, CAddrIndexEntry> > &vWrite,
+                                const std::vector<std::pair<CAddrIndexKey, CAddrIndexEntry> > &vErase) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<CAddrIndexKey, CAddrIndexEntry> >::const_iterator it = vErase.begin(); it != vErase.end(); it++) {
+        batch.Erase(make_pair(DB_ADDRINDEX, it->first));
+        batch.Erase(CAddrIndexHeightKey(it->first.first, CAddrIndexPos(it->second.nHeight, it->first.second)));
+    }
+    for (std::vector<std::pair<CAddrIndexKey, CAddrIndexEntry> >::const_iterator it = vWrite.begin(); it != vWrite.end(); it++) {
+        batch.Write(make_pair(DB_ADDRINDEX, it->first), it->second);
+        batch.Write(CAddrIndexHeightKey(it->first.first, CAddrIndexPos(it->second.nHeight, it->first.second)), '\0');
+    }
+    return WriteBatch(batch);
+}
+
+bool CAddrIndexDB::ReadOutputs(const uint256 &hashScript, const CAddrIndexPos *pafter, size_t nMax,
+                               std::vector<std::pair<COutPoint, CAddrIndexEntry> > &vOutputs) {
+    vOutputs.clear();
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    if (pafter)
+        pcursor->Seek(CAddrIndexHeightKey(hashScript, *pafter));
+    else
+        pcursor->Seek(make_pair(DB_ADDRINDEX_HEIGHT, hashScript));
+
+    for (; pcursor->Valid() && vOutputs.size() < nMax; pcursor->Next()) {
+        CAddrIndexHeightKey key;
+        if (!pcursor->GetKey(key) || key.chType != DB_ADDRINDEX_HEIGHT || key.hashScript != hashScript)
+            break;
+        if (pafter && key.pos.nHeight == pafter->nHeight && key.pos.out == pafter->out)
+            continue;
+        CAddrIndexEntry entry;
+        if (!ReadEntry(make_pair(hashScript, key.pos.out), entry))
+            return error("%s: missing entry for %s", __func__, key.pos.out.ToString());
+        vOutputs.push_back(make_pair(key.pos.out, entry));
+    }
+    return true;
+}
+
+bool CAddrIndexDB::ReadBestBlock(CBlockLocator &locator) const {
+    return Read(DB_BEST_BLOCK, locator);
+}
+
+bool CAddrIndexDB::WriteBestBlock(const CBlockLocator &locator) {
+    return Write(DB_BEST_BLOCK, locator);
+}
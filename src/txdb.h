@@ -6,9 +6,11 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "blockindexfile.h"
 #include "coins.h"
 #include "dbwrapper.h"
 #include "chain.h"
+#include "sync.h"
 
 #include <map>
 #include <string>
@@ -16,9 +18,12 @@
 #include <vector>
 
 #include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
 
 class CBlockIndex;
 class CCoinsViewDBCursor;
+class CTxidFilter;
 class uint256;
 
 //! -dbcache default (MiB)
@@ -27,6 +32,8 @@ static const int64_t nDefaultDbCache = 100;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! -coinsfilter default (MiB)
+static const int64_t DEFAULT_COINS_FILTER_SIZE = 32;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -53,19 +60,58 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
-/** CCoinsView backed by the coin database (chainstate/) */
+/**
+ * CCoinsView backed by the coin database (chainstate/)
+ *
+ * Optionally keeps a CTxidFilter over the txids in the database, so that
+ * lookups of transactions that aren't in it (unknown or spent parents of
+ * relayed transactions, most of all) don't reach LevelDB. The filter is
+ * built by scanning the database on a background thread, and again once it
+ * has had many txids added since; until the first build is done, every
+ * lookup goes to the database.
+ */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CDBWrapper db;
+
+    //! Protects the filters and their settings
+    mutable CCriticalSection cs_filter;
+    //! Filter over all txids in db, once built
+    boost::scoped_ptr<CTxidFilter> pfilter;
+    //! Filter being built by threadFilter, which BatchWrite adds to as well
+    boost::scoped_ptr<CTxidFilter> pfilterNext;
+    //! Size of the filters in bytes, or 0 if disabled
+    size_t nFilterBytes;
+    //! Number of txids added to pfilter after which it is rebuilt
+    size_t nFilterRebuildAt;
+    //! Only used from the thread owning this object
+    boost::scoped_ptr<boost::thread> threadFilter;
+
+    bool MayHaveCoins(const uint256 &txid) const;
+    void StartFilterBuild();
+    void StopFilterBuild();
+    void ThreadBuildFilter();
+
 public:
-    CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CCoinsViewDB(const CDBTuning& tuning, bool fMemory = false, bool fWipe = false);
+    ~CCoinsViewDB();
 
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
     CCoinsViewCursor *Cursor() const;
+
+    /** Wait until the last BatchWrite is written, which happens in the background. Throws dbwrapper_error if it failed. */
+    void WaitForWrites();
+
+    const CDBWrapper& GetDB() const { return db; }
+
+    /** Keep a filter of nBytes over the txids in the database, and start building it. 0 disables it. */
+    void SetFilterSize(size_t nBytes);
+    /** Wait for a filter build in progress, if any. */
+    void WaitForFilter();
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -90,25 +136,116 @@ private:
     friend class CCoinsViewDB;
 };
 
-/** Access to the block database (blocks/index/) */
+/** Access to the block database (blocks/index/), and its flat-file copy (blocks/blockindex.dat) */
 class CBlockTreeDB : public CDBWrapper
 {
 public:
-    CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CBlockTreeDB(const CDBTuning& tuning, bool fMemory = false, bool fWipe = false);
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
+
+    bool fUseIndexFile;
+    CBlockIndexFile indexfile;
 public:
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &fileinfo);
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool &fReindex);
-    bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
-    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    /** Whether the flat block index file is missing or mostly stale, given the number of index entries. */
+    bool IndexFileNeedsRewrite(size_t nEntries) const;
+    /** Replace the flat block index file with the given (complete and flushed) set of entries. */
+    bool RewriteIndexFile(const std::vector<const CBlockIndex*>& blockinfo);
+};
+
+/** Access to the transaction index database (indexes/txindex/) */
+class CTxIndexDB : public CDBWrapper
+{
+public:
+    CTxIndexDB(const CDBTuning& tuning, bool fMemory = false, bool fWipe = false);
+private:
+    CTxIndexDB(const CTxIndexDB&);
+    void operator=(const CTxIndexDB&);
+public:
+    bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) const;
+    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    bool ReadBestBlock(CBlockLocator &locator) const;
+    bool WriteBestBlock(const CBlockLocator &locator);
+};
+
+/** An output in the address index: where it was created, and where it was spent */
+struct CAddrIndexEntry
+{
+    int nHeight;
+    CAmount nValue;
+    COutPoint spentBy; //!< Spending transaction and input, null if unspent
+    int nSpentHeight;
+
+    CAddrIndexEntry() : nHeight(0), nValue(0), nSpentHeight(0) {}
+    CAddrIndexEntry(int nHeightIn, CAmount nValueIn) : nHeight(nHeightIn), nValue(nValueIn), nSpentHeight(0) {}
+
+    bool IsSpent() const { return !spentBy.IsNull(); }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(VARINT(nHeight));
+        READWRITE(VARINT(nValue));
+        READWRITE(spentBy);
+        READWRITE(VARINT(nSpentHeight));
+    }
+};
+
+/** An output of a script (by the SHA256 hash of its scriptPubKey) in the address index */
+typedef std::pair<uint256, COutPoint> CAddrIndexKey;
+
+/** Position in the list of a script's outputs, which is ordered by height */
+struct CAddrIndexPos
+{
+    uint32_t nHeight;
+    COutPoint out;
+
+    CAddrIndexPos() : nHeight(0), out(uint256(), 0) {}
+    CAddrIndexPos(uint32_t nHeightIn, const COutPoint& outIn) : nHeight(nHeightIn), out(outIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nHeight);
+        READWRITE(out);
+    }
+};
+
+/**
+ * Access to the address index database (indexes/addrindex/)
+ *
+ * Every output is stored under its script hash and outpoint, and listed a
+ * second time under its script hash and height, with no data, so that a
+ * script's outputs can be paged through in the order they were created.
+ */
+class CAddrIndexDB : public CDBWrapper
+{
+public:
+    CAddrIndexDB(const CDBTuning& tuning, bool fMemory = false, bool fWipe = false);
+private:
+    CAddrIndexDB(const CAddrIndexDB&);
+    void operator=(const CAddrIndexDB&);
+public:
+    bool ReadEntry(const CAddrIndexKey &key, CAddrIndexEntry &entry) const;
+    /** Write the given entries, and remove the given ones, as one batch. */
+    bool WriteEntries(const std::vector<std::pair<CAddrIndexKey, CAddrIndexEntry> > &vWrite,
+                      const std::vector<std::pair<CAddrIndexKey, CAddrIndexEntry> > &vErase);
+    /** Read up to nMax outputs of a script, in order of height, after pafter if given. */
+    bool ReadOutputs(const uint256 &hashScript, const CAddrIndexPos *pafter, size_t nMax,
+                     std::vector<std::pair<COutPoint, CAddrIndexEntry> > &vOutputs);
+    bool ReadBestBlock(CBlockLocator &locator) const;
+    bool WriteBestBlock(const CBlockLocator &locator);
 };
 
 #endif // BITCOIN_TXDB_H
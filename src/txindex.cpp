@@ -0,0 +1,47 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txindex.h"
+
+#include "main.h"
+
+#include <boost/foreach.hpp>
+
+CTxIndex* ptxindex = NULL;
+
+CTxIndex::CTxIndex(const CDBTuning& tuning, bool fMemory, bool fWipe) : db(tuning, fMemory, fWipe)
+{
+}
+
+bool CTxIndex::ReadBestBlock(CBlockLocator& locator) const
+{
+    return db.ReadBestBlock(locator);
+}
+
+bool CTxIndex::WriteBestBlock(const CBlockLocator& locator)
+{
+    return db.WriteBestBlock(locator);
+}
+
+bool CTxIndex::FindTx(const uint256& txid, CDiskTxPos& pos) const
+{
+    return db.ReadTxIndex(txid, pos);
+}
+
+bool CTxIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CDiskBlockPos posBlock;
+    {
+        LOCK(cs_main);
+        posBlock = pindex->GetBlockPos();
+    }
+    CDiskTxPos pos(posBlock, GetSizeOfCompactSize(block.vtx.size()));
+    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+    vPos.reserve(block.vtx.size());
+    BOOST_FOREACH(const CTransactionRef& tx, block.vtx) {
+        vPos.push_back(std::make_pair(tx->GetHash(), pos));
+        pos.nTxOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
+    }
+    return db.WriteTxIndex(vPos);
+}
@@ -0,0 +1,43 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXINDEX_H
+#define BITCOIN_TXINDEX_H
+
+#include "chainindex.h"
+#include "txdb.h"
+
+struct CDiskTxPos;
+class uint256;
+
+/**
+ * Transaction index (-txindex): the position on disk of every transaction in
+ * the active chain, kept in its own database (indexes/txindex/).
+ *
+ * Entries of blocks that are disconnected are left in place, as before; a
+ * transaction that is confirmed again is written again.
+ */
+class CTxIndex : public CChainIndex
+{
+private:
+    CTxIndexDB db;
+
+protected:
+    const char* GetName() const { return "transaction index"; }
+    bool ReadBestBlock(CBlockLocator& locator) const;
+    bool WriteBestBlock(const CBlockLocator& locator);
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex);
+
+public:
+    CTxIndex(const CDBTuning& tuning, bool fMemory = false, bool fWipe = false);
+
+    /** Look up the position of a transaction. Returns false if it is not (yet) indexed. */
+    bool FindTx(const uint256& txid, CDiskTxPos& pos) const;
+
+    const CTxIndexDB& GetDB() const { return db; }
+};
+
+extern CTxIndex* ptxindex;
+
+#endif // BITCOIN_TXINDEX_H
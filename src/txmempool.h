@@ -6,11 +6,13 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <deque>
 #include <list>
 #include <set>
 
 #include "amount.h"
 #include "coins.h"
+#include "flatset.h"
 #include "primitives/transaction.h"
 #include "sync.h"
 
@@ -18,9 +20,11 @@
 #include "boost/multi_index_container.hpp"
 #include "boost/multi_index/ordered_index.hpp"
 #include "boost/multi_index/hashed_index.hpp"
+#include "boost/multi_index/sequenced_index.hpp"
 
 class CAutoFile;
 class CBlockIndex;
+class CTxMemPoolOverflow;
 
 inline double AllowFreeThreshold()
 {
@@ -74,7 +78,7 @@ class CTxMemPool;
 class CTxMemPoolEntry
 {
 private:
-    CTransaction tx;
+    CTransactionRef tx;
     CAmount nFee;              //!< Cached to avoid expensive parent-transaction lookups
     size_t nTxSize;            //!< ... and avoid recomputing tx size
     size_t nModSize;           //!< ... and modified size for priority
@@ -104,14 +108,19 @@ private:
     CAmount nModFeesWithAncestors;
     unsigned int nSigOpCountWithAncestors;
 
+    //! Marker used by CTxMemPool to visit each entry once per graph walk
+    mutable uint64_t nWalkEpoch;
+    friend class CTxMemPool;
+
 public:
-    CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
+    CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                     int64_t _nTime, double _entryPriority, unsigned int _entryHeight,
                     bool poolHasNoInputsOf, CAmount _inChainInputValue, bool spendsCoinbase,
                     unsigned int nSigOps, LockPoints lp);
     CTxMemPoolEntry(const CTxMemPoolEntry& other);
 
-    const CTransaction& GetTx() const { return this->tx; }
+    const CTransaction& GetTx() const { return *this->tx; }
+    CTransactionRef GetSharedTx() const { return this->tx; }
     /**
      * Fast calculation of lower bound of current priority as update
      * from entry priority. Only inputs that were originally in-chain will age.
@@ -209,6 +218,16 @@ struct mempoolentry_txid
     {
         return entry.GetTx().GetHash();
     }
+
+    result_type operator() (const CTransaction &tx) const
+    {
+        return tx.GetHash();
+    }
+
+    result_type operator() (const CTransactionRef &tx) const
+    {
+        return tx->GetHash();
+    }
 };
 
 /** \class CompareTxMemPoolEntryByDescendantScore
@@ -303,6 +322,7 @@ struct descendant_score {};
 struct entry_time {};
 struct mining_score {};
 struct ancestor_score {};
+struct insertion_order {};
 
 class CBlockPolicyEstimator;
 
@@ -320,6 +340,34 @@ public:
     size_t DynamicMemoryUsage() const { return 0; }
 };
 
+/** Reason why a transaction was removed from the mempool */
+enum class MemPoolRemovalReason {
+    UNKNOWN = 0, //! Manually removed or unknown reason
+    EXPIRY,      //! Expired from mempool
+    SIZELIMIT,   //! Removed in size limiting
+    REORG,       //! Removed for reorganization
+    BLOCK,       //! Removed for block
+    CONFLICT,    //! Removed for conflict with in-block transaction
+    REPLACED     //! Removed for replacement
+};
+
+std::string RemovalReasonToString(MemPoolRemovalReason reason);
+
+/** Maximum number of changes kept in the mempool's change journal */
+static const unsigned int MEMPOOL_JOURNAL_SIZE = 100000;
+
+/** An addition to or removal from the mempool, as recorded in its change journal */
+struct CTxMemPoolChange
+{
+    uint64_t nSequence;          //!< Mempool sequence number assigned to this change
+    uint256 txid;
+    bool fAdded;                 //!< Whether the transaction was added (or removed)
+    MemPoolRemovalReason reason; //!< Why it was removed; UNKNOWN for additions
+
+    CTxMemPoolChange(uint64_t nSequenceIn, const uint256& txidIn, bool fAddedIn, MemPoolRemovalReason reasonIn) :
+        nSequence(nSequenceIn), txid(txidIn), fAdded(fAddedIn), reason(reasonIn) {}
+};
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain
  * transactions that may be included in the next block.
@@ -413,7 +461,11 @@ private:
     mutable bool blockSinceLastRollingFeeBump;
     mutable double rollingMinimumFeeRate; //!< minimum fee to get into the pool, decreases exponentially
 
+    uint64_t nSequence; //!< Sequence number of the latest addition or removal
+    std::deque<CTxMemPoolChange> journal; //!< The latest (up to MEMPOOL_JOURNAL_SIZE) changes, in sequence order
+
     void trackPackageRemoved(const CFeeRate& rate);
+    void AddToJournal(const uint256& txid, bool fAdded, MemPoolRemovalReason reason);
 
 public:
 
@@ -459,7 +511,7 @@ public:
             return a->GetTx().GetHash() < b->GetTx().GetHash();
         }
     };
-    typedef std::set<txiter, CompareIteratorByHash> setEntries;
+    typedef flatset<txiter, CompareIteratorByHash> setEntries;
 
     const setEntries & GetMemPoolParents(txiter entry) const;
     const setEntries & GetMemPoolChildren(txiter entry) const;
@@ -477,6 +529,24 @@ private:
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
+    //! Epoch of the current ancestor/descendant walk; see StartWalk()
+    mutable uint64_t nWalkEpoch;
+    //! Scratch space for the walks, kept around to avoid reallocating it
+    mutable std::vector<txiter> vWalkStage;
+
+    /** Begin a new walk over the transaction graph. Entries are marked as
+     *  visited by stamping them with the returned epoch, so no per-walk set
+     *  of seen entries needs to be built. Requires cs (or exclusive access). */
+    uint64_t StartWalk() const { vWalkStage.clear(); return ++nWalkEpoch; }
+    //! Mark an entry as visited in the given walk; returns whether it already was
+    bool Visited(txiter it, uint64_t epoch) const
+    {
+        if (it->nWalkEpoch == epoch)
+            return true;
+        it->nWalkEpoch = epoch;
+        return false;
+    }
+
 public:
     std::map<COutPoint, CInPoint> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
@@ -505,10 +575,10 @@ public:
     bool addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, bool fCurrentEstimate = true);
     bool addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, setEntries &setAncestors, bool fCurrentEstimate = true);
 
-    void removeRecursive(const CTransaction &tx, std::list<CTransaction>& removed);
+    void removeRecursive(const CTransaction &tx, std::list<CTransaction>& removed, MemPoolRemovalReason reason = MemPoolRemovalReason::UNKNOWN);
     void removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight, int flags);
     void removeConflicts(const CTransaction &tx, std::list<CTransaction>& removed);
-    void removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight,
+    void removeForBlock(const std::vector<CTransactionRef>& vtx, unsigned int nBlockHeight,
                         std::list<CTransaction>& conflicts, bool fCurrentEstimate = true);
     void clear();
     void _clear(); //lock free
@@ -536,7 +606,7 @@ public:
      *  Set updateDescendants to true when removing a tx that was in a block, so
      *  that any in-mempool descendants have their ancestor state updated.
      */
-    void RemoveStaged(setEntries &stage, bool updateDescendants);
+    void RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason = MemPoolRemovalReason::UNKNOWN);
 
     /** When adding transactions from a disconnected block back to the mempool,
      *  new mempool entries may have children in the mempool (which is generally
@@ -577,8 +647,10 @@ public:
     /** Remove transactions from the mempool until its dynamic size is <= sizelimit.
       *  pvNoSpendsRemaining, if set, will be populated with the list of transactions
       *  which are not in mempool which no longer have any spends in this mempool.
+      *  pOverflow, if set, receives the removed transactions (parents before
+      *  children) instead of them being discarded.
       */
-    void TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRemaining=NULL);
+    void TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRemaining=NULL, CTxMemPoolOverflow* pOverflow=NULL);
 
     /** Expire all transaction (and their dependencies) in the mempool older than time. Return the number of removed transactions. */
     int Expire(int64_t time);
@@ -595,6 +667,20 @@ public:
         return totalTxSize;
     }
 
+    uint64_t GetSequence() const
+    {
+        LOCK(cs);
+        return nSequence;
+    }
+
+    /**
+     * Get the changes made to the mempool after sequence number nSince, oldest
+     * first. Returns false if some of them have already dropped out of the
+     * journal (or nSince was never reached), in which case the caller has to
+     * start over from a full snapshot of the mempool.
+     */
+    bool GetChangesSince(uint64_t nSince, std::vector<CTxMemPoolChange>& vChanges) const;
+
     bool exists(uint256 hash) const
     {
         LOCK(cs);
@@ -602,6 +688,8 @@ public:
     }
 
     bool lookup(uint256 hash, CTransaction& result) const;
+    /** The mempool's own reference to a transaction, without copying it; NULL if it isn't in the mempool. */
+    CTransactionRef get(const uint256& hash) const;
     bool lookupFeeRate(const uint256& hash, CFeeRate& feeRate) const;
 
     /** Estimate fee rate needed to get into the next nBlocks
@@ -664,7 +752,7 @@ private:
      *  transactions in a chain before we've updated all the state for the
      *  removal.
      */
-    void removeUnchecked(txiter entry);
+    void removeUnchecked(txiter entry, MemPoolRemovalReason reason = MemPoolRemovalReason::UNKNOWN);
 };
 
 /** 
@@ -695,4 +783,69 @@ struct TxCoinAgePriorityCompare
     }
 };
 
+/** Maximum kilobytes for transactions to store for processing during reorg */
+static const size_t MAX_DISCONNECTED_TX_POOL_SIZE = 20000;
+
+/**
+ * DisconnectedBlockTransactions
+ *
+ * During the reorg, it's desirable to re-add previously confirmed transactions
+ * to the mempool, so that anything not re-confirmed in the new chain is
+ * available to be mined. However, it's more efficient to wait until the reorg
+ * is complete and process all still-unconfirmed transactions at that time,
+ * since we expect most confirmed transactions to (typically) still be
+ * confirmed in the new chain, and re-accepting to the memory pool is expensive
+ * (and therefore better to not do in the middle of reorg-processing).
+ * Instead, store the disconnected transactions (in order!) as we go, remove any
+ * that are included in blocks in the new chain, and then process the remaining
+ * still-unconfirmed transactions at the end, with a single call to
+ * CTxMemPool::UpdateTransactionsFromBlock().
+ *
+ * The insertion_order index keeps transactions in the order in which they
+ * were added: since blocks are disconnected from the tip backwards, and each
+ * block's transactions are added in reverse, walking it backwards yields the
+ * transactions in a valid (topological) order for re-adding to the mempool.
+ */
+class DisconnectedBlockTransactions
+{
+public:
+    typedef boost::multi_index_container<
+        CTransactionRef,
+        boost::multi_index::indexed_by<
+            // sorted by txid
+            boost::multi_index::hashed_unique<mempoolentry_txid, SaltedTxidHasher>,
+            // sorted by order in the blockchain
+            boost::multi_index::sequenced<
+                boost::multi_index::tag<insertion_order>
+            >
+        >
+    > indexed_disconnected_transactions;
+
+    typedef indexed_disconnected_transactions::index<insertion_order>::type::iterator insertion_iter;
+
+    indexed_disconnected_transactions queuedTx;
+
+    DisconnectedBlockTransactions() : cachedInnerUsage(0) {}
+
+    // It's almost certainly a logic bug if we don't clear out queuedTx before
+    // destruction, as we add to it while disconnecting blocks, and then we
+    // need to re-process remaining transactions to ensure mempool consistency.
+    ~DisconnectedBlockTransactions() { assert(queuedTx.empty()); }
+
+    /** Estimate of the memory used by the queued transactions */
+    size_t DynamicMemoryUsage() const;
+
+    void addTransaction(const CTransactionRef& tx);
+
+    /** Remove transactions that were confirmed in a newly connected block */
+    void removeForBlock(const std::vector<CTransactionRef>& vtx);
+
+    void removeEntry(insertion_iter entry);
+
+    void clear();
+
+private:
+    uint64_t cachedInnerUsage; //!< sum of dynamic memory usage of the queued transactions
+};
+
 #endif // BITCOIN_TXMEMPOOL_H
@@ -0,0 +1,241 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txmempooloverflow.h"
+
+#include "clientversion.h"
+#include "memusage.h"
+#include "streams.h"
+#include "util.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <boost/foreach.hpp>
+
+/** Don't bother compacting the file while it holds less than this many dead bytes */
+static const unsigned int OVERFLOW_COMPACT_SLACK = 1000000;
+
+namespace {
+
+struct update_pos
+{
+    update_pos(unsigned int _nPos) : nPos(_nPos) {}
+    void operator() (CTxMemPoolOverflow::entry& e) { e.nPos = nPos; }
+
+private:
+    unsigned int nPos;
+};
+
+}
+
+CTxMemPoolOverflow::CTxMemPoolOverflow() :
+    file(NULL), nSequence(0), nMaxSize(0), nFileSize(0), nLiveSize(0)
+{
+}
+
+CTxMemPoolOverflow::~CTxMemPoolOverflow()
+{
+    Close();
+}
+
+bool CTxMemPoolOverflow::Open(const boost::filesystem::path& path, uint64_t nMaxSizeIn)
+{
+    LOCK(cs);
+    if (file)
+        fclose(file);
+    mapEntries.clear();
+    nFileSize = 0;
+    nLiveSize = 0;
+    nMaxSize = std::min(nMaxSizeIn, (uint64_t)MAX_MEMPOOL_OVERFLOW_SIZE * 1000000);
+    file = fopen(path.string().c_str(), "w+b");
+    if (!file)
+        return error("%s: unable to open %s", __func__, path.string());
+    return true;
+}
+
+void CTxMemPoolOverflow::Close()
+{
+    LOCK(cs);
+    if (file) {
+        fclose(file);
+        file = NULL;
+    }
+    mapEntries.clear();
+    nFileSize = 0;
+    nLiveSize = 0;
+}
+
+bool CTxMemPoolOverflow::IsOpen() const
+{
+    LOCK(cs);
+    return file != NULL;
+}
+
+void CTxMemPoolOverflow::EraseUnchecked(indexed_entry_set::iterator it)
+{
+    nLiveSize -= it->nSize;
+    mapEntries.erase(it);
+}
+
+bool CTxMemPoolOverflow::ReadUnchecked(const entry& e, CTransactionRef& tx)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss.resize(e.nSize);
+    if (fseek(file, e.nPos, SEEK_SET) || fread(&ss[0], 1, e.nSize, file) != e.nSize)
+        return false;
+    try {
+        ss >> tx;
+    } catch (const std::exception&) {
+        return false;
+    }
+    return tx->GetHash() == e.txid;
+}
+
+void CTxMemPoolOverflow::CompactUnchecked()
+{
+    if (!file || nFileSize <= 2 * (uint64_t)nLiveSize + OVERFLOW_COMPACT_SLACK)
+        return;
+
+    // Slide the live records towards the start of the file, in file order, so
+    // that no record is overwritten before it has been moved.
+    std::vector<std::pair<unsigned int, uint256> > vLive;
+    vLive.reserve(mapEntries.size());
+    for (indexed_entry_set::iterator it = mapEntries.begin(); it != mapEntries.end(); ++it)
+        vLive.push_back(std::make_pair(it->nPos, it->txid));
+    std::sort(vLive.begin(), vLive.end());
+
+    unsigned int nWritePos = 0;
+    std::vector<char> vch;
+    for (std::vector<std::pair<unsigned int, uint256> >::const_iterator vit = vLive.begin(); vit != vLive.end(); ++vit) {
+        indexed_entry_set::iterator it = mapEntries.find(vit->second);
+        vch.resize(it->nSize);
+        if (fseek(file, it->nPos, SEEK_SET) || fread(&vch[0], 1, it->nSize, file) != it->nSize) {
+            EraseUnchecked(it);
+            continue;
+        }
+        if (nWritePos != it->nPos) {
+            if (fseek(file, nWritePos, SEEK_SET) || fwrite(&vch[0], 1, it->nSize, file) != it->nSize) {
+                // The record may now be partially overwritten; give up on it
+                // and everything after it.
+                LogPrintf("%s: write failed, dropping %u transactions\n", __func__, vLive.end() - vit);
+                for (; vit != vLive.end(); ++vit)
+                    EraseUnchecked(mapEntries.find(vit->second));
+                break;
+            }
+            mapEntries.modify(it, update_pos(nWritePos));
+        }
+        nWritePos += it->nSize;
+    }
+    LogPrint("mempool", "Compacted mempool overflow file from %u to %u bytes\n", nFileSize, nWritePos);
+    nFileSize = nWritePos;
+    TruncateFile(file, nFileSize);
+}
+
+void CTxMemPoolOverflow::Add(const CTransaction& tx, const CFeeRate& feeRate, int64_t nTime)
+{
+    LOCK(cs);
+    const uint256& txid = tx.GetHash();
+    if (!file || mapEntries.count(txid))
+        return;
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << tx;
+    if (ss.size() > nMaxSize || (uint64_t)nFileSize + ss.size() > std::numeric_limits<unsigned int>::max())
+        return;
+    if (fseek(file, nFileSize, SEEK_SET) || fwrite(&ss[0], 1, ss.size(), file) != ss.size()) {
+        LogPrintf("%s: unable to write transaction %s\n", __func__, txid.ToString());
+        return;
+    }
+
+    entry e;
+    e.txid = txid;
+    e.feeRate = feeRate;
+    e.nSequence = nSequence++;
+    e.nPos = nFileSize;
+    e.nSize = ss.size();
+    e.nTime = nTime;
+    mapEntries.insert(e);
+    nFileSize += e.nSize;
+    nLiveSize += e.nSize;
+
+    // Over the limit, forget the lowest feerate transactions first.
+    while (nLiveSize > nMaxSize) {
+        indexed_entry_set::index<feerate>::type::iterator it = mapEntries.get<feerate>().end();
+        EraseUnchecked(mapEntries.project<0>(--it));
+    }
+    CompactUnchecked();
+}
+
+bool CTxMemPoolOverflow::PopBest(const CFeeRate& minFeeRate, CTransactionRef& txOut)
+{
+    LOCK(cs);
+    while (!mapEntries.empty()) {
+        indexed_entry_set::index<feerate>::type::iterator it = mapEntries.get<feerate>().begin();
+        if (it->feeRate < minFeeRate)
+            return false;
+        bool fRead = ReadUnchecked(*it, txOut);
+        EraseUnchecked(mapEntries.project<0>(it));
+        CompactUnchecked();
+        if (fRead)
+            return true;
+    }
+    return false;
+}
+
+void CTxMemPoolOverflow::RemoveForBlock(const std::vector<CTransactionRef>& vtx)
+{
+    LOCK(cs);
+    if (mapEntries.empty())
+        return;
+    BOOST_FOREACH(const CTransactionRef& tx, vtx) {
+        indexed_entry_set::iterator it = mapEntries.find(tx->GetHash());
+        if (it != mapEntries.end())
+            EraseUnchecked(it);
+    }
+    CompactUnchecked();
+}
+
+unsigned int CTxMemPoolOverflow::Expire(int64_t time)
+{
+    LOCK(cs);
+    unsigned int nRemoved = 0;
+    indexed_entry_set::index<entry_time>::type::iterator it = mapEntries.get<entry_time>().begin();
+    while (it != mapEntries.get<entry_time>().end() && it->nTime < time) {
+        EraseUnchecked(mapEntries.project<0>(it++));
+        nRemoved++;
+    }
+    if (nRemoved)
+        CompactUnchecked();
+    return nRemoved;
+}
+
+void CTxMemPoolOverflow::Clear()
+{
+    LOCK(cs);
+    mapEntries.clear();
+    nLiveSize = 0;
+    nFileSize = 0;
+    if (file)
+        TruncateFile(file, 0);
+}
+
+unsigned long CTxMemPoolOverflow::size() const
+{
+    LOCK(cs);
+    return mapEntries.size();
+}
+
+uint64_t CTxMemPoolOverflow::GetDiskUsage() const
+{
+    LOCK(cs);
+    return nFileSize;
+}
+
+size_t CTxMemPoolOverflow::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    // Estimate the overhead of mapEntries to be 6 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
+    return memusage::MallocUsage(sizeof(entry) + 6 * sizeof(void*)) * mapEntries.size();
+}
@@ -0,0 +1,131 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXMEMPOOLOVERFLOW_H
+#define BITCOIN_TXMEMPOOLOVERFLOW_H
+
+#include "amount.h"
+#include "coins.h"
+#include "primitives/transaction.h"
+#include "sync.h"
+
+#include <stdio.h>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+#undef foreach
+#include "boost/multi_index_container.hpp"
+#include "boost/multi_index/hashed_index.hpp"
+#include "boost/multi_index/member.hpp"
+#include "boost/multi_index/ordered_index.hpp"
+
+/** Default for -maxmempooloverflow, maximum megabytes of evicted transactions kept on disk */
+static const unsigned int DEFAULT_MAX_MEMPOOL_OVERFLOW_SIZE = 300;
+
+/** Upper bound on -maxmempooloverflow, in megabytes */
+static const unsigned int MAX_MEMPOOL_OVERFLOW_SIZE = 1024;
+
+/**
+ * Disk-backed overflow tier for the memory pool.
+ *
+ * Packages that CTxMemPool::TrimToSize evicts to stay within -maxmempool are
+ * appended to a flat file in the data directory instead of being forgotten.
+ * Only a small index entry per transaction (txid, package feerate, position
+ * in the file) is kept in memory. When the pool's minimum fee falls again or
+ * a block makes room, the highest-feerate transactions are handed back to be
+ * resubmitted through AcceptToMemoryPool, which re-validates them.
+ *
+ * The file is a cache only: it is truncated when opened, and compacted in
+ * place once most of it is taken up by transactions no longer indexed.
+ */
+class CTxMemPoolOverflow
+{
+public:
+    struct entry {
+        uint256 txid;
+        CFeeRate feeRate;     //!< Feerate of the package the transaction was evicted with
+        uint64_t nSequence;   //!< Insertion order, so parents are handed back before children
+        unsigned int nPos;    //!< Offset of the serialized transaction in the file
+        unsigned int nSize;   //!< ... and its length
+        int64_t nTime;        //!< Time the transaction originally entered the mempool
+    };
+
+private:
+    struct feerate {};
+    struct entry_time {};
+
+    struct CompareEntryByFeeRate
+    {
+        bool operator()(const entry& a, const entry& b) const
+        {
+            if (a.feeRate == b.feeRate)
+                return a.nSequence < b.nSequence;
+            return a.feeRate > b.feeRate;
+        }
+    };
+
+    typedef boost::multi_index_container<
+        entry,
+        boost::multi_index::indexed_by<
+            // sorted by txid
+            boost::multi_index::hashed_unique<boost::multi_index::member<entry, uint256, &entry::txid>, SaltedTxidHasher>,
+            // sorted by package feerate, highest first
+            boost::multi_index::ordered_unique<
+                boost::multi_index::tag<feerate>,
+                boost::multi_index::identity<entry>,
+                CompareEntryByFeeRate
+            >,
+            // sorted by original mempool entry time
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<entry_time>,
+                boost::multi_index::member<entry, int64_t, &entry::nTime>
+            >
+        >
+    > indexed_entry_set;
+
+    mutable CCriticalSection cs;
+    FILE* file;
+    indexed_entry_set mapEntries;
+    uint64_t nSequence;
+    unsigned int nMaxSize;  //!< Limit on nLiveSize, in bytes
+    unsigned int nFileSize; //!< Bytes written to the file
+    unsigned int nLiveSize; //!< Bytes of the file referenced by mapEntries
+
+    void EraseUnchecked(indexed_entry_set::iterator it);
+    bool ReadUnchecked(const entry& e, CTransactionRef& tx);
+    void CompactUnchecked();
+
+public:
+    CTxMemPoolOverflow();
+    ~CTxMemPoolOverflow();
+
+    /**
+     * Start using (and truncate) the store at path, keeping at most nMaxSizeIn
+     * bytes of transactions on disk. File offsets are 32 bits, so the limit is
+     * capped at MAX_MEMPOOL_OVERFLOW_SIZE.
+     */
+    bool Open(const boost::filesystem::path& path, uint64_t nMaxSizeIn);
+    void Close();
+    bool IsOpen() const;
+
+    /** Store a transaction evicted from the mempool as part of a package with the given feerate. */
+    void Add(const CTransaction& tx, const CFeeRate& feeRate, int64_t nTime);
+    /**
+     * Remove and return the best stored transaction, if its package feerate
+     * is at least minFeeRate. Entries that cannot be read back are dropped.
+     */
+    bool PopBest(const CFeeRate& minFeeRate, CTransactionRef& txOut);
+    /** Forget transactions that were included in a block. */
+    void RemoveForBlock(const std::vector<CTransactionRef>& vtx);
+    /** Forget transactions that entered the mempool before time. Returns the number removed. */
+    unsigned int Expire(int64_t time);
+    void Clear();
+
+    unsigned long size() const;
+    uint64_t GetDiskUsage() const;
+    size_t DynamicMemoryUsage() const;
+};
+
+#endif // BITCOIN_TXMEMPOOLOVERFLOW_H